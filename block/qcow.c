@@ -769,8 +769,9 @@ static int qcow_make_empty(BlockDriverState *bs)
 
 /* XXX: put compressed sectors first, then all the cluster aligned
    tables to avoid losing bytes in alignment */
-static int qcow_write_compressed(BlockDriverState *bs, int64_t sector_num,
-                                 const uint8_t *buf, int nb_sectors)
+static int qcow_write_compressed_cluster(BlockDriverState *bs,
+                                         int64_t sector_num,
+                                         const uint8_t *buf)
 {
     BDRVQcowState *s = bs->opaque;
     z_stream strm;
@@ -778,9 +779,6 @@ static int qcow_write_compressed(BlockDriverState *bs, int64_t sector_num,
     uint8_t *out_buf;
     uint64_t cluster_offset;
 
-    if (nb_sectors != s->cluster_sectors)
-        return -EINVAL;
-
     out_buf = g_malloc(s->cluster_size + (s->cluster_size / 1000) + 128);
 
     /* best compression, small window, no zlib header */
@@ -835,6 +833,28 @@ fail:
     return ret;
 }
 
+static int qcow_write_compressed(BlockDriverState *bs, int64_t sector_num,
+                                 const uint8_t *buf, int nb_sectors)
+{
+    BDRVQcowState *s = bs->opaque;
+    int ret;
+
+    if (nb_sectors % s->cluster_sectors)
+        return -EINVAL;
+
+    while (nb_sectors > 0) {
+        ret = qcow_write_compressed_cluster(bs, sector_num, buf);
+        if (ret < 0) {
+            return ret;
+        }
+        sector_num += s->cluster_sectors;
+        buf += s->cluster_size;
+        nb_sectors -= s->cluster_sectors;
+    }
+
+    return 0;
+}
+
 static coroutine_fn int qcow_co_flush(BlockDriverState *bs)
 {
     return bdrv_co_flush(bs->file);
@@ -22,8 +22,6 @@
  * THE SOFTWARE.
  */
 
-#include <zlib.h>
-
 #include "qemu-common.h"
 #include "block_int.h"
 #include "block/qcow2.h"
@@ -622,7 +620,12 @@ int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m)
         qcow2_cache_depends_on_flush(s->l2_table_cache);
     }
 
-    qcow2_cache_set_dependency(bs, s->l2_table_cache, s->refcount_block_cache);
+    /* With lazy refcounts the image is dirty, so a crash between the L2 and
+     * the refcount update is repaired on the next open */
+    if (!s->use_lazy_refcounts) {
+        qcow2_cache_set_dependency(bs, s->l2_table_cache,
+                                   s->refcount_block_cache);
+    }
     ret = get_cluster_table(bs, m->offset, &l2_table, &l2_offset, &l2_index);
     if (ret < 0) {
         goto err;
@@ -666,6 +669,51 @@ err:
     return ret;
  }
 
+/*
+ * Check if there already is an AIO write request in flight which allocates
+ * the same cluster. In this case we need to wait until the previous
+ * request has completed and updated the L2 table accordingly.
+ *
+ * Returns 0 if the request may go ahead; *nb_clusters is reduced so that it
+ * stops before the first running allocation that it would run into.  Returns
+ * -EAGAIN after waiting for a dependency, in which case the caller must look
+ * at the L2 table again.
+ */
+static int handle_dependencies(BlockDriverState *bs, uint64_t guest_offset,
+    unsigned int *nb_clusters)
+{
+    BDRVQcowState *s = bs->opaque;
+    QCowL2Meta *old_alloc;
+    uint64_t start = guest_offset >> s->cluster_bits;
+    uint64_t end = start + *nb_clusters;
+
+    QLIST_FOREACH(old_alloc, &s->cluster_allocs, next_in_flight) {
+
+        uint64_t old_start = old_alloc->offset >> s->cluster_bits;
+        uint64_t old_end = old_start + old_alloc->nb_clusters;
+
+        if (end <= old_start || start >= old_end) {
+            /* No intersection */
+            continue;
+        }
+
+        if (start < old_start) {
+            /* Stop at the start of a running allocation */
+            end = old_start;
+        } else {
+            /* Wait for the dependency to complete. We need to recheck
+             * the free/allocated clusters when we continue. */
+            qemu_co_mutex_unlock(&s->lock);
+            qemu_co_queue_wait(&old_alloc->dependent_requests);
+            qemu_co_mutex_lock(&s->lock);
+            return -EAGAIN;
+        }
+    }
+
+    *nb_clusters = end - start;
+    return 0;
+}
+
 /*
  * alloc_cluster_offset
  *
@@ -692,17 +740,28 @@ int qcow2_alloc_cluster_offset(BlockDriverState *bs, uint64_t offset,
     int l2_index, ret;
     uint64_t l2_offset, *l2_table;
     int64_t cluster_offset;
-    unsigned int nb_clusters, i = 0;
-    QCowL2Meta *old_alloc;
+    unsigned int nb_clusters, i;
+
+again:
+    nb_clusters = size_to_clusters(s, n_end << 9);
+
+    /*
+     * Resolve conflicts with running allocations before looking at the L2
+     * table, so that a request which has to wait doesn't keep the table
+     * referenced in the cache while it sleeps.
+     */
+    ret = handle_dependencies(bs, offset, &nb_clusters);
+    if (ret == -EAGAIN) {
+        goto again;
+    } else if (ret < 0) {
+        return ret;
+    }
 
     ret = get_cluster_table(bs, offset, &l2_table, &l2_offset, &l2_index);
     if (ret < 0) {
         return ret;
     }
 
-again:
-    nb_clusters = size_to_clusters(s, n_end << 9);
-
     nb_clusters = MIN(nb_clusters, s->l2_size - l2_index);
 
     cluster_offset = be64_to_cpu(l2_table[l2_index]);
@@ -726,6 +785,7 @@ again:
 
     /* how many available clusters ? */
 
+    i = 0;
     while (i < nb_clusters) {
         i += count_contiguous_clusters(nb_clusters - i, s->cluster_size,
                 &l2_table[l2_index], i, 0);
@@ -748,39 +808,6 @@ again:
     assert(i <= nb_clusters);
     nb_clusters = i;
 
-    /*
-     * Check if there already is an AIO write request in flight which allocates
-     * the same cluster. In this case we need to wait until the previous
-     * request has completed and updated the L2 table accordingly.
-     */
-    QLIST_FOREACH(old_alloc, &s->cluster_allocs, next_in_flight) {
-
-        uint64_t start = offset >> s->cluster_bits;
-        uint64_t end = start + nb_clusters;
-        uint64_t old_start = old_alloc->offset >> s->cluster_bits;
-        uint64_t old_end = old_start + old_alloc->nb_clusters;
-
-        if (end < old_start || start > old_end) {
-            /* No intersection */
-        } else {
-            if (start < old_start) {
-                /* Stop at the start of a running allocation */
-                nb_clusters = old_start - start;
-            } else {
-                nb_clusters = 0;
-            }
-
-            if (nb_clusters == 0) {
-                /* Wait for the dependency to complete. We need to recheck
-                 * the free/allocated clusters when we continue. */
-                qemu_co_mutex_unlock(&s->lock);
-                qemu_co_queue_wait(&old_alloc->dependent_requests);
-                qemu_co_mutex_lock(&s->lock);
-                goto again;
-            }
-        }
-    }
-
     if (!nb_clusters) {
         abort();
     }
@@ -820,33 +847,6 @@ fail_put:
     return ret;
 }
 
-static int decompress_buffer(uint8_t *out_buf, int out_buf_size,
-                             const uint8_t *buf, int buf_size)
-{
-    z_stream strm1, *strm = &strm1;
-    int ret, out_len;
-
-    memset(strm, 0, sizeof(*strm));
-
-    strm->next_in = (uint8_t *)buf;
-    strm->avail_in = buf_size;
-    strm->next_out = out_buf;
-    strm->avail_out = out_buf_size;
-
-    ret = inflateInit2(strm, -12);
-    if (ret != Z_OK)
-        return -1;
-    ret = inflate(strm, Z_FINISH);
-    out_len = strm->next_out - out_buf;
-    if ((ret != Z_STREAM_END && ret != Z_BUF_ERROR) ||
-        out_len != out_buf_size) {
-        inflateEnd(strm);
-        return -1;
-    }
-    inflateEnd(strm);
-    return 0;
-}
-
 int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t cluster_offset)
 {
     BDRVQcowState *s = bs->opaque;
@@ -863,8 +863,9 @@ int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t cluster_offset)
         if (ret < 0) {
             return ret;
         }
-        if (decompress_buffer(s->cluster_cache, s->cluster_size,
-                              s->cluster_data + sector_offset, csize) < 0) {
+        if (qcow2_decompress_buffer(s->cluster_cache, s->cluster_size,
+                                    s->cluster_data + sector_offset,
+                                    csize) < 0) {
             return -EIO;
         }
         s->cluster_cache_offset = coffset;
@@ -872,6 +873,125 @@ int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t cluster_offset)
     return 0;
 }
 
+/*
+ * Decompresses up to nb_clusters consecutive compressed clusters into buf,
+ * starting with the cluster at the guest offset 'offset' whose L2 entry is
+ * cluster_offset. The run ends at the first cluster that isn't compressed.
+ * Compressed clusters that were written one after another are also adjacent
+ * in the image file, so their data is read with a single request whenever
+ * possible and then inflated in parallel by the zlib worker pool. The last
+ * cluster is kept in the compressed cluster cache.
+ *
+ * Returns the number of clusters decompressed or -errno.
+ */
+int qcow2_decompress_clusters(BlockDriverState *bs, uint64_t offset,
+    uint64_t cluster_offset, int nb_clusters, uint8_t *buf)
+{
+    BDRVQcowState *s = bs->opaque;
+    Qcow2ZPool *pool;
+    Qcow2ZJob *jobs;
+    uint64_t *coffsets;
+    int *nb_csectors;
+    uint8_t *cbuf = NULL;
+    int64_t start, end;
+    int i, n, ret;
+
+    coffsets = g_malloc(nb_clusters * sizeof(uint64_t));
+    nb_csectors = g_malloc(nb_clusters * sizeof(int));
+    jobs = g_malloc0(nb_clusters * sizeof(Qcow2ZJob));
+
+    /* Collect the run of compressed clusters */
+    start = end = 0;
+    for (i = 0; i < nb_clusters; i++) {
+        if (i > 0) {
+            n = s->cluster_sectors;
+            ret = qcow2_get_cluster_offset(bs, offset + i * s->cluster_size,
+                                           &n, &cluster_offset);
+            if (ret < 0) {
+                goto fail;
+            }
+            if (!(cluster_offset & QCOW_OFLAG_COMPRESSED)) {
+                break;
+            }
+        }
+
+        coffsets[i] = cluster_offset & s->cluster_offset_mask;
+        nb_csectors[i] =
+            ((cluster_offset >> s->csize_shift) & s->csize_mask) + 1;
+
+        if (i == 0) {
+            start = coffsets[0] >> 9;
+        } else if ((coffsets[i] >> 9) < start) {
+            break;
+        }
+        end = MAX(end, (int64_t)(coffsets[i] >> 9) + nb_csectors[i]);
+    }
+    nb_clusters = i;
+
+    /* Read the compressed data of all clusters at once if it is contiguous,
+     * and each cluster on its own otherwise */
+    if (end - start <= nb_clusters * (s->cluster_sectors + 1)) {
+        cbuf = qemu_blockalign(bs, (end - start) * 512);
+        BLKDBG_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
+        ret = bdrv_read(bs->file, start, cbuf, end - start);
+        if (ret < 0) {
+            goto fail;
+        }
+        for (i = 0; i < nb_clusters; i++) {
+            jobs[i].in_buf = cbuf + coffsets[i] - start * 512;
+        }
+    } else {
+        /* The compressed data of a cluster may take up to twice the cluster
+         * size, so each cluster gets as many sectors as its L2 entry says */
+        uint8_t *p;
+        int64_t total = 0;
+
+        for (i = 0; i < nb_clusters; i++) {
+            total += nb_csectors[i];
+        }
+        cbuf = qemu_blockalign(bs, total * 512);
+        for (i = 0, p = cbuf; i < nb_clusters; i++) {
+            BLKDBG_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
+            ret = bdrv_read(bs->file, coffsets[i] >> 9, p, nb_csectors[i]);
+            if (ret < 0) {
+                goto fail;
+            }
+            jobs[i].in_buf = p + (coffsets[i] & 511);
+            p += nb_csectors[i] * 512;
+        }
+    }
+
+    pool = nb_clusters > 1 ? qcow2_zpool_get(bs) : NULL;
+    for (i = 0; i < nb_clusters; i++) {
+        jobs[i].compress = false;
+        jobs[i].in_len = nb_csectors[i] * 512 - (coffsets[i] & 511);
+        jobs[i].out_buf = buf + i * s->cluster_size;
+        jobs[i].out_size = s->cluster_size;
+        qcow2_zpool_submit(pool, &jobs[i]);
+    }
+
+    ret = nb_clusters;
+    for (i = 0; i < nb_clusters; i++) {
+        if (qcow2_zpool_wait(pool, &jobs[i]) < 0) {
+            ret = -EIO;
+        }
+    }
+    if (ret < 0) {
+        goto fail;
+    }
+
+    memcpy(s->cluster_cache, buf + (nb_clusters - 1) * s->cluster_size,
+           s->cluster_size);
+    s->cluster_cache_offset = coffsets[nb_clusters - 1];
+
+fail:
+    qemu_vfree(cbuf);
+    g_free(jobs);
+    g_free(nb_csectors);
+    g_free(coffsets);
+    return ret;
+}
+
 /*
  * This discards as many clusters of nb_clusters as possible at once (i.e.
  * all clusters in the same L2 table) and returns the number of discarded
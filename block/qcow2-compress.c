@@ -0,0 +1,267 @@
+/*
+ * zlib worker pool for compressed clusters in the QCOW2 format
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Deflating a cluster is by far the most expensive part of writing a
+ * compressed image, and inflating it the most expensive part of reading one.
+ * Both only depend on the cluster data, so callers that handle several
+ * clusters at once queue one job per cluster here and let a pool of worker
+ * threads do the zlib work while the caller itself keeps doing the I/O in
+ * order.  The workers never touch the BlockDriverState.
+ */
+
+#include <zlib.h>
+
+#include "qemu-common.h"
+#include "qemu-thread.h"
+#include "block_int.h"
+#include "block/qcow2.h"
+
+struct Qcow2ZPool {
+    QemuMutex lock;
+    QemuCond request_cond;
+    QemuCond done_cond;
+    QSIMPLEQ_HEAD(, Qcow2ZJob) requests;
+    bool stopping;
+    int nb_threads;
+    QemuThread threads[QCOW2_MAX_COMPRESS_THREADS];
+};
+
+/*
+ * Compresses in_len bytes into out_buf. Returns the compressed length, 0 if
+ * the data does not fit into out_size bytes after compression (i.e. it must
+ * be stored uncompressed), or -EINVAL on zlib errors.
+ */
+int qcow2_compress_buffer(uint8_t *out_buf, int out_size,
+                          const uint8_t *buf, int in_len)
+{
+    z_stream strm;
+    int ret, out_len;
+
+    /* best compression, small window, no zlib header */
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION,
+                       Z_DEFLATED, -12,
+                       9, Z_DEFAULT_STRATEGY);
+    if (ret != 0) {
+        return -EINVAL;
+    }
+
+    strm.avail_in = in_len;
+    strm.next_in = (uint8_t *)buf;
+    strm.avail_out = out_size;
+    strm.next_out = out_buf;
+
+    ret = deflate(&strm, Z_FINISH);
+    if (ret != Z_STREAM_END && ret != Z_OK) {
+        deflateEnd(&strm);
+        return -EINVAL;
+    }
+    out_len = strm.next_out - out_buf;
+
+    deflateEnd(&strm);
+
+    if (ret != Z_STREAM_END || out_len >= in_len) {
+        return 0;
+    }
+    return out_len;
+}
+
+int qcow2_decompress_buffer(uint8_t *out_buf, int out_buf_size,
+                            const uint8_t *buf, int buf_size)
+{
+    z_stream strm1, *strm = &strm1;
+    int ret, out_len;
+
+    memset(strm, 0, sizeof(*strm));
+
+    strm->next_in = (uint8_t *)buf;
+    strm->avail_in = buf_size;
+    strm->next_out = out_buf;
+    strm->avail_out = out_buf_size;
+
+    ret = inflateInit2(strm, -12);
+    if (ret != Z_OK)
+        return -1;
+    ret = inflate(strm, Z_FINISH);
+    out_len = strm->next_out - out_buf;
+    if ((ret != Z_STREAM_END && ret != Z_BUF_ERROR) ||
+        out_len != out_buf_size) {
+        inflateEnd(strm);
+        return -1;
+    }
+    inflateEnd(strm);
+    return 0;
+}
+
+static void qcow2_zjob_run(Qcow2ZJob *job)
+{
+    if (job->compress) {
+        job->ret = qcow2_compress_buffer(job->out_buf, job->out_size,
+                                         job->in_buf, job->in_len);
+    } else {
+        job->ret = qcow2_decompress_buffer(job->out_buf, job->out_size,
+                                           job->in_buf, job->in_len);
+        if (job->ret < 0) {
+            job->ret = -EIO;
+        }
+    }
+}
+
+static void *qcow2_zpool_worker(void *opaque)
+{
+    Qcow2ZPool *pool = opaque;
+    Qcow2ZJob *job;
+
+    qemu_mutex_lock(&pool->lock);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&pool->requests) && !pool->stopping) {
+            qemu_cond_wait(&pool->request_cond, &pool->lock);
+        }
+        if (pool->stopping) {
+            break;
+        }
+
+        job = QSIMPLEQ_FIRST(&pool->requests);
+        QSIMPLEQ_REMOVE_HEAD(&pool->requests, next);
+        qemu_mutex_unlock(&pool->lock);
+
+        qcow2_zjob_run(job);
+
+        qemu_mutex_lock(&pool->lock);
+        job->done = true;
+        qemu_cond_broadcast(&pool->done_cond);
+    }
+    qemu_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static int qcow2_zpool_nb_threads(void)
+{
+    long n;
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    n = info.dwNumberOfProcessors;
+#else
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return MAX(1, MIN(n, QCOW2_MAX_COMPRESS_THREADS));
+}
+
+/*
+ * Returns the worker pool of the image, starting it on first use. Returns
+ * NULL on single processor hosts, where jobs are simply run by the caller.
+ */
+Qcow2ZPool *qcow2_zpool_get(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    Qcow2ZPool *pool;
+    int i, nb_threads;
+
+    if (s->zpool) {
+        return s->zpool;
+    }
+
+    nb_threads = qcow2_zpool_nb_threads();
+    if (nb_threads == 1) {
+        return NULL;
+    }
+
+    pool = g_malloc0(sizeof(*pool));
+    qemu_mutex_init(&pool->lock);
+    qemu_cond_init(&pool->request_cond);
+    qemu_cond_init(&pool->done_cond);
+    QSIMPLEQ_INIT(&pool->requests);
+
+    pool->nb_threads = nb_threads;
+    for (i = 0; i < nb_threads; i++) {
+        qemu_thread_create(&pool->threads[i], qcow2_zpool_worker, pool,
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    s->zpool = pool;
+    return pool;
+}
+
+void qcow2_zpool_destroy(Qcow2ZPool *pool)
+{
+    int i;
+
+    if (!pool) {
+        return;
+    }
+
+    qemu_mutex_lock(&pool->lock);
+    assert(QSIMPLEQ_EMPTY(&pool->requests));
+    pool->stopping = true;
+    qemu_cond_broadcast(&pool->request_cond);
+    qemu_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nb_threads; i++) {
+        qemu_thread_join(&pool->threads[i]);
+    }
+
+    qemu_cond_destroy(&pool->done_cond);
+    qemu_cond_destroy(&pool->request_cond);
+    qemu_mutex_destroy(&pool->lock);
+    g_free(pool);
+}
+
+/*
+ * Queues a job. Without a pool, the job is completed before returning. Jobs
+ * are picked up in submission order, so waiting for them in the same order
+ * keeps all workers busy.
+ */
+void qcow2_zpool_submit(Qcow2ZPool *pool, Qcow2ZJob *job)
+{
+    job->done = false;
+
+    if (!pool) {
+        qcow2_zjob_run(job);
+        job->done = true;
+        return;
+    }
+
+    qemu_mutex_lock(&pool->lock);
+    QSIMPLEQ_INSERT_TAIL(&pool->requests, job, next);
+    qemu_cond_signal(&pool->request_cond);
+    qemu_mutex_unlock(&pool->lock);
+}
+
+/* Waits until job is completed and returns its result */
+int qcow2_zpool_wait(Qcow2ZPool *pool, Qcow2ZJob *job)
+{
+    if (pool) {
+        qemu_mutex_lock(&pool->lock);
+        while (!job->done) {
+            qemu_cond_wait(&pool->done_cond, &pool->lock);
+        }
+        qemu_mutex_unlock(&pool->lock);
+    }
+
+    assert(job->done);
+    return job->ret;
+}
@@ -431,6 +431,15 @@ static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
         return 0;
     }
 
+    /* Refcount blocks may be written back after the tables referencing the
+     * clusters, so the image must be marked dirty first */
+    if (s->use_lazy_refcounts) {
+        ret = qcow2_mark_dirty(bs);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
     if (addend < 0) {
         qcow2_cache_set_dependency(bs, s->refcount_block_cache,
             s->l2_table_cache);
@@ -1065,14 +1074,21 @@ fail:
 /*
  * Checks an image for refcount consistency.
  *
+ * With repair set, the refcounts saved in the image are corrected to match
+ * the references found in the L1/L2 tables, snapshots and metadata.  This is
+ * used to recover images that had lazy refcount updates and weren't closed
+ * cleanly.
+ *
  * Returns 0 if no errors are found, the number of errors in case the image is
  * detected as corrupted, and -errno when an internal error occurred.
  */
-int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res)
+int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
+                          bool repair)
 {
     BDRVQcowState *s = bs->opaque;
     int64_t size;
     int nb_clusters, refcount1, refcount2, i;
+    int repaired_leaks = 0, repaired_corruptions = 0;
     QCowSnapshot *sn;
     uint16_t *refcount_table;
     int ret;
@@ -1085,9 +1101,10 @@ int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res)
     inc_refcounts(bs, res, refcount_table, nb_clusters,
         0, s->cluster_size);
 
-    /* current L1 table */
+    /* current L1 table; QCOW_OFLAG_COPIED can only be checked against the
+     * refcounts once they have been repaired */
     ret = check_refcounts_l1(bs, res, refcount_table, nb_clusters,
-                       s->l1_table_offset, s->l1_size, 1);
+                       s->l1_table_offset, s->l1_size, !repair);
     if (ret < 0) {
         goto fail;
     }
@@ -1139,6 +1156,15 @@ int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res)
         }
     }
 
+    /* Refcount blocks that have to be allocated during the repair must not
+     * take a cluster whose saved refcount is still too low, nor one that the
+     * loop below hasn't reached yet.  update_refcount() lowers
+     * free_cluster_index when it frees a leaked cluster, so it is reset after
+     * each repaired cluster. */
+    if (repair) {
+        s->free_cluster_index = nb_clusters;
+    }
+
     /* compare ref counts */
     for(i = 0; i < nb_clusters; i++) {
         refcount1 = get_refcount(bs, i);
@@ -1150,7 +1176,20 @@ int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res)
         }
 
         refcount2 = refcount_table[i];
-        if (refcount1 != refcount2) {
+        if (refcount1 != refcount2 && repair) {
+            ret = update_refcount(bs, (int64_t) i << s->cluster_bits, 1,
+                                  refcount2 - refcount1);
+            s->free_cluster_index = nb_clusters;
+            if (ret < 0) {
+                fprintf(stderr, "ERROR could not repair cluster %d: %s\n",
+                        i, strerror(-ret));
+                res->check_errors++;
+            } else if (refcount1 > refcount2) {
+                repaired_leaks++;
+            } else {
+                repaired_corruptions++;
+            }
+        } else if (refcount1 != refcount2) {
             fprintf(stderr, "%s cluster %d refcount=%d reference=%d\n",
                    refcount1 < refcount2 ? "ERROR" : "Leaked",
                    i, refcount1, refcount2);
@@ -1162,6 +1201,21 @@ int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res)
         }
     }
 
+    if (repair) {
+        if (repaired_leaks || repaired_corruptions) {
+            fprintf(stderr, "Repaired the refcounts of %d clusters "
+                    "(%d leaked, %d too low)\n",
+                    repaired_leaks + repaired_corruptions,
+                    repaired_leaks, repaired_corruptions);
+        }
+        s->free_cluster_index = 0;
+        ret = qcow2_cache_flush(bs, s->refcount_block_cache);
+        if (ret < 0) {
+            res->check_errors++;
+            goto fail;
+        }
+    }
+
     ret = 0;
 
 fail:
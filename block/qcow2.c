@@ -24,11 +24,11 @@
 #include "qemu-common.h"
 #include "block_int.h"
 #include "module.h"
-#include <zlib.h>
 #include "aes.h"
 #include "block/qcow2.h"
 #include "qemu-error.h"
 #include "qerror.h"
+#include "qemu-timer.h"
 
 /*
   Differences with QCOW:
@@ -165,6 +165,173 @@ static void cleanup_unknown_header_ext(BlockDriverState *bs)
     }
 }
 
+/*
+ * Sets the dirty bit and flushes the header, so that the refcounts are rebuilt
+ * if the image isn't closed cleanly.  This must happen before any refcount
+ * update is allowed to lag behind the L1/L2 tables on disk.
+ */
+int qcow2_mark_dirty(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t val;
+    int ret;
+
+    assert(s->qcow_version >= 3);
+
+    if (s->incompatible_features & QCOW2_INCOMPAT_DIRTY) {
+        return 0;
+    }
+
+    val = cpu_to_be64(s->incompatible_features | QCOW2_INCOMPAT_DIRTY);
+    ret = bdrv_pwrite(bs->file, offsetof(QCowHeader, incompatible_features),
+                      &val, sizeof(val));
+    if (ret < 0) {
+        return ret;
+    }
+    ret = bdrv_flush(bs->file);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Only treat the image as dirty once the header says so */
+    s->incompatible_features |= QCOW2_INCOMPAT_DIRTY;
+    return 0;
+}
+
+/*
+ * Writes back all refcounts and clears the dirty bit.  Called when the image
+ * is closed and after the refcounts of a dirty image have been rebuilt.
+ */
+static int qcow2_mark_clean(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int ret;
+
+    if (!(s->incompatible_features & QCOW2_INCOMPAT_DIRTY)) {
+        return 0;
+    }
+
+    ret = qcow2_cache_flush(bs, s->l2_table_cache);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = qcow2_cache_flush(bs, s->refcount_block_cache);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->incompatible_features &= ~QCOW2_INCOMPAT_DIRTY;
+    ret = qcow2_update_header(bs);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return bdrv_flush(bs->file);
+}
+
+/*
+ * Sizes given with -drive l2-cache-size/refcount-cache-size are used as they
+ * are, apart from enforcing the minimum the driver needs; sizes above the
+ * maximum fail the open.  Otherwise the L2 cache grows with the image until
+ * it maps all of it or DEFAULT_L2_CACHE_MAX is reached, and the refcount
+ * block cache gets a quarter of that.
+ */
+static int qcow2_cache_sizes(BlockDriverState *bs, int *l2_tables,
+                             int *refcount_blocks)
+{
+    BDRVQcowState *s = bs->opaque;
+    BlockCacheConfig *config = &bs->cache_config;
+    int max_tables = MIN(QCOW2_MAX_CACHE_TABLES,
+                         QCOW2_MAX_CACHE_SIZE / s->cluster_size);
+    int64_t n;
+
+    if (config->l2_size / s->cluster_size > max_tables) {
+        error_report("l2-cache-size may not exceed %" PRId64 " bytes "
+                     "for an image with %d byte clusters",
+                     (int64_t) max_tables * s->cluster_size, s->cluster_size);
+        return -EINVAL;
+    }
+    if (config->refcount_size / s->cluster_size > max_tables) {
+        error_report("refcount-cache-size may not exceed %" PRId64 " bytes "
+                     "for an image with %d byte clusters",
+                     (int64_t) max_tables * s->cluster_size, s->cluster_size);
+        return -EINVAL;
+    }
+
+    if (config->l2_size) {
+        n = config->l2_size / s->cluster_size;
+    } else {
+        n = MIN(s->l1_vm_state_index, DEFAULT_L2_CACHE_MAX / s->cluster_size);
+        n = MIN(MAX(n, L2_CACHE_SIZE), max_tables);
+    }
+    *l2_tables = MAX(n, MIN_L2_CACHE_SIZE);
+
+    if (config->refcount_size) {
+        n = config->refcount_size / s->cluster_size;
+    } else {
+        n = *l2_tables / 4;
+    }
+    *refcount_blocks = MAX(n, REFCOUNT_CACHE_SIZE);
+
+    return 0;
+}
+
+static void coroutine_fn qcow2_cache_clean_co(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcowState *s = bs->opaque;
+
+    /* Errors leave the tables dirty; the next flush will report them */
+    qemu_co_mutex_lock(&s->lock);
+    qcow2_cache_clean(bs, s->l2_table_cache);
+    qcow2_cache_clean(bs, s->refcount_block_cache);
+    qemu_co_mutex_unlock(&s->lock);
+
+    s->cache_clean_co = NULL;
+    if (s->cache_clean_timer) {
+        qemu_mod_timer(s->cache_clean_timer, qemu_get_clock_ms(rt_clock) +
+                       s->cache_clean_interval * 1000);
+    }
+}
+
+static void qcow2_cache_clean_timer_cb(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcowState *s = bs->opaque;
+
+    s->cache_clean_co = qemu_coroutine_create(qcow2_cache_clean_co);
+    qemu_coroutine_enter(s->cache_clean_co, bs);
+}
+
+static void qcow2_cache_clean_timer_init(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+
+    if (s->cache_clean_interval > 0) {
+        s->cache_clean_timer = qemu_new_timer_ms(rt_clock,
+            qcow2_cache_clean_timer_cb, bs);
+        qemu_mod_timer(s->cache_clean_timer, qemu_get_clock_ms(rt_clock) +
+                       s->cache_clean_interval * 1000);
+    }
+}
+
+static void qcow2_cache_clean_timer_del(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+
+    if (s->cache_clean_timer) {
+        qemu_del_timer(s->cache_clean_timer);
+        qemu_free_timer(s->cache_clean_timer);
+        s->cache_clean_timer = NULL;
+    }
+
+    /* A writeback that is in flight must finish before the caches go away */
+    while (s->cache_clean_co) {
+        qemu_aio_wait();
+    }
+}
+
 static int qcow2_open(BlockDriverState *bs, int flags)
 {
     BDRVQcowState *s = bs->opaque;
@@ -172,6 +339,7 @@ static int qcow2_open(BlockDriverState *bs, int flags)
     QCowHeader header;
     uint64_t ext_end;
     bool writethrough;
+    int l2_cache_size, refcount_cache_size;
 
     ret = bdrv_pread(bs->file, 0, &header, sizeof(header));
     if (ret < 0) {
@@ -195,7 +363,7 @@ static int qcow2_open(BlockDriverState *bs, int flags)
         ret = -EINVAL;
         goto fail;
     }
-    if (header.version != QCOW_VERSION) {
+    if (header.version < 2 || header.version > 3) {
         char version[64];
         snprintf(version, sizeof(version), "QCOW version %d", header.version);
         qerror_report(QERR_UNKNOWN_BLOCK_FORMAT_FEATURE,
@@ -203,6 +371,51 @@ static int qcow2_open(BlockDriverState *bs, int flags)
         ret = -ENOTSUP;
         goto fail;
     }
+    s->qcow_version = header.version;
+
+    /* Version 2 images have no feature bits */
+    if (header.version == 2) {
+        header.incompatible_features    = 0;
+        header.compatible_features      = 0;
+        header.autoclear_features       = 0;
+        header.refcount_order           = 4;
+        header.header_length            = QCOW2_V2_HEADER_LENGTH;
+    } else {
+        be64_to_cpus(&header.incompatible_features);
+        be64_to_cpus(&header.compatible_features);
+        be64_to_cpus(&header.autoclear_features);
+        be32_to_cpus(&header.refcount_order);
+        be32_to_cpus(&header.header_length);
+
+        if (header.header_length < sizeof(header)) {
+            ret = -EINVAL;
+            goto fail;
+        }
+    }
+
+    if (header.incompatible_features & ~QCOW2_INCOMPAT_MASK) {
+        char feature[64];
+        snprintf(feature, sizeof(feature), "incompatible features %" PRIx64,
+            header.incompatible_features & ~(uint64_t)QCOW2_INCOMPAT_MASK);
+        qerror_report(QERR_UNKNOWN_BLOCK_FORMAT_FEATURE,
+            bs->device_name, "qcow2", feature);
+        ret = -ENOTSUP;
+        goto fail;
+    }
+
+    if (header.refcount_order != 4) {
+        char refcount[64];
+        snprintf(refcount, sizeof(refcount), "%d bit reference counts",
+                 1 << header.refcount_order);
+        qerror_report(QERR_UNKNOWN_BLOCK_FORMAT_FEATURE,
+            bs->device_name, "qcow2", refcount);
+        ret = -ENOTSUP;
+        goto fail;
+    }
+
+    s->incompatible_features    = header.incompatible_features;
+    s->compatible_features      = header.compatible_features;
+    s->autoclear_features       = header.autoclear_features;
     if (header.cluster_bits < MIN_CLUSTER_BITS ||
         header.cluster_bits > MAX_CLUSTER_BITS) {
         ret = -EINVAL;
@@ -257,9 +470,18 @@ static int qcow2_open(BlockDriverState *bs, int flags)
 
     /* alloc L2 table/refcount block cache */
     writethrough = ((flags & BDRV_O_CACHE_WB) == 0);
-    s->l2_table_cache = qcow2_cache_create(bs, L2_CACHE_SIZE, writethrough);
-    s->refcount_block_cache = qcow2_cache_create(bs, REFCOUNT_CACHE_SIZE,
-        writethrough);
+    ret = qcow2_cache_sizes(bs, &l2_cache_size, &refcount_cache_size);
+    if (ret < 0) {
+        goto fail;
+    }
+    s->use_lazy_refcounts =
+        (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS) != 0;
+
+    /* With lazy refcounts, refcount blocks are only written back when they
+     * are evicted or the image is flushed, even in writethrough mode */
+    s->l2_table_cache = qcow2_cache_create(bs, l2_cache_size, writethrough);
+    s->refcount_block_cache = qcow2_cache_create(bs, refcount_cache_size,
+        writethrough && !s->use_lazy_refcounts);
 
     s->cluster_cache = g_malloc(s->cluster_size);
     /* one more sector for decompressed data alignment */
@@ -281,7 +503,7 @@ static int qcow2_open(BlockDriverState *bs, int flags)
     } else {
         ext_end = s->cluster_size;
     }
-    if (qcow2_read_extensions(bs, sizeof(header), ext_end)) {
+    if (qcow2_read_extensions(bs, header.header_length, ext_end)) {
         ret = -EINVAL;
         goto fail;
     }
@@ -305,13 +527,40 @@ static int qcow2_open(BlockDriverState *bs, int flags)
         goto fail;
     }
 
+    /* Clear unknown autoclear feature bits */
+    if (!bs->read_only && s->autoclear_features != 0) {
+        s->autoclear_features = 0;
+        ret = qcow2_update_header(bs);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    /* The refcounts of a dirty image may be stale, rebuild them */
+    if (!bs->read_only && (s->incompatible_features & QCOW2_INCOMPAT_DIRTY)) {
+        BdrvCheckResult result = {0};
+
+        ret = qcow2_check_refcounts(bs, &result, true);
+        if (ret < 0) {
+            goto fail;
+        }
+
+        ret = qcow2_mark_clean(bs);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
     /* Initialise locks */
     qemu_co_mutex_init(&s->lock);
 
+    s->cache_clean_interval = bs->cache_config.clean_interval;
+    qcow2_cache_clean_timer_init(bs);
+
 #ifdef DEBUG_ALLOC
     {
         BdrvCheckResult result = {0};
-        qcow2_check_refcounts(bs, &result);
+        qcow2_check_refcounts(bs, &result, false);
     }
 #endif
     return ret;
@@ -324,6 +573,9 @@ static int qcow2_open(BlockDriverState *bs, int flags)
     if (s->l2_table_cache) {
         qcow2_cache_destroy(bs, s->l2_table_cache);
     }
+    if (s->refcount_block_cache) {
+        qcow2_cache_destroy(bs, s->refcount_block_cache);
+    }
     g_free(s->cluster_cache);
     qemu_vfree(s->cluster_data);
     return ret;
@@ -419,6 +671,7 @@ static coroutine_fn int qcow2_co_readv(BlockDriverState *bs, int64_t sector_num,
     uint64_t bytes_done = 0;
     QEMUIOVector hd_qiov;
     uint8_t *cluster_data = NULL;
+    uint8_t *zdata = NULL;
 
     qemu_iovec_init(&hd_qiov, qiov->niov);
 
@@ -466,15 +719,45 @@ static coroutine_fn int qcow2_co_readv(BlockDriverState *bs, int64_t sector_num,
                 qemu_iovec_memset(&hd_qiov, 0, 512 * cur_nr_sectors);
             }
         } else if (cluster_offset & QCOW_OFLAG_COMPRESSED) {
-            /* add AIO support for compressed blocks ? */
-            ret = qcow2_decompress_cluster(bs, cluster_offset);
-            if (ret < 0) {
-                goto fail;
-            }
+            int nb_clusters;
+
+            nb_clusters = MIN(size_to_clusters(s,
+                                  (index_in_cluster + remaining_sectors) * 512),
+                              MAX(1, QCOW2_MAX_DECOMPRESS_BATCH >>
+                                     s->cluster_bits));
+
+            if (nb_clusters > 1 && s->cluster_cache_offset !=
+                (cluster_offset & s->cluster_offset_mask)) {
+                /* the request spans several clusters, read ahead and
+                 * inflate them in parallel */
+                if (!zdata) {
+                    zdata = g_malloc((size_t)nb_clusters * s->cluster_size);
+                }
+                ret = qcow2_decompress_clusters(bs,
+                    (sector_num - index_in_cluster) << 9, cluster_offset,
+                    nb_clusters, zdata);
+                if (ret < 0) {
+                    goto fail;
+                }
+
+                cur_nr_sectors = MIN(remaining_sectors,
+                    ret * s->cluster_sectors - index_in_cluster);
+                qemu_iovec_reset(&hd_qiov);
+                qemu_iovec_copy(&hd_qiov, qiov, bytes_done,
+                    cur_nr_sectors * 512);
+                qemu_iovec_from_buffer(&hd_qiov,
+                    zdata + index_in_cluster * 512,
+                    512 * cur_nr_sectors);
+            } else {
+                ret = qcow2_decompress_cluster(bs, cluster_offset);
+                if (ret < 0) {
+                    goto fail;
+                }
 
-            qemu_iovec_from_buffer(&hd_qiov,
-                s->cluster_cache + index_in_cluster * 512,
-                512 * cur_nr_sectors);
+                qemu_iovec_from_buffer(&hd_qiov,
+                    s->cluster_cache + index_in_cluster * 512,
+                    512 * cur_nr_sectors);
+            }
         } else {
             if ((cluster_offset & 511) != 0) {
                 ret = -EIO;
@@ -529,15 +812,18 @@ fail:
 
     qemu_iovec_destroy(&hd_qiov);
     qemu_vfree(cluster_data);
+    g_free(zdata);
 
     return ret;
 }
 
 static void run_dependent_requests(BDRVQcowState *s, QCowL2Meta *m)
 {
-    /* Take the request off the list of running requests */
+    /* Take the request off the list of running requests.  This may be called
+     * again on the error path, so make sure it happens only once. */
     if (m->nb_clusters != 0) {
         QLIST_REMOVE(m, next_in_flight);
+        m->nb_clusters = 0;
     }
 
     /* Restart all dependent requests */
@@ -653,12 +939,21 @@ static void qcow2_close(BlockDriverState *bs)
     BDRVQcowState *s = bs->opaque;
     g_free(s->l1_table);
 
+    qcow2_cache_clean_timer_del(bs);
+
+    if (!bs->read_only) {
+        qcow2_mark_clean(bs);
+    }
+
     qcow2_cache_flush(bs, s->l2_table_cache);
     qcow2_cache_flush(bs, s->refcount_block_cache);
 
     qcow2_cache_destroy(bs, s->l2_table_cache);
     qcow2_cache_destroy(bs, s->refcount_block_cache);
 
+    qcow2_zpool_destroy(s->zpool);
+    s->zpool = NULL;
+
     cleanup_unknown_header_ext(bs);
     g_free(s->cluster_cache);
     qemu_vfree(s->cluster_data);
@@ -697,6 +992,22 @@ static void qcow2_invalidate_cache(BlockDriverState *bs)
     }
 }
 
+static BlockCacheStatsList *qcow2_get_cache_stats(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    BlockCacheStatsList *l2, *refcount;
+
+    refcount = g_malloc0(sizeof(*refcount));
+    refcount->value = qcow2_cache_get_stats(s->refcount_block_cache,
+                                            "refcount");
+
+    l2 = g_malloc0(sizeof(*l2));
+    l2->value = qcow2_cache_get_stats(s->l2_table_cache, "l2");
+    l2->next = refcount;
+
+    return l2;
+}
+
 static size_t header_ext_add(char *buf, uint32_t magic, const void *s,
     size_t len, size_t buflen)
 {
@@ -730,6 +1041,7 @@ int qcow2_update_header(BlockDriverState *bs)
     QCowHeader *header;
     char *buf;
     size_t buflen = s->cluster_size;
+    size_t header_length;
     int ret;
     uint64_t total_size;
     uint32_t refcount_table_clusters;
@@ -746,12 +1058,15 @@ int qcow2_update_header(BlockDriverState *bs)
         goto fail;
     }
 
+    header_length = s->qcow_version >= 3 ? sizeof(*header)
+                                         : QCOW2_V2_HEADER_LENGTH;
+
     total_size = bs->total_sectors * BDRV_SECTOR_SIZE;
     refcount_table_clusters = s->refcount_table_size >> (s->cluster_bits - 3);
 
     *header = (QCowHeader) {
         .magic                  = cpu_to_be32(QCOW_MAGIC),
-        .version                = cpu_to_be32(QCOW_VERSION),
+        .version                = cpu_to_be32(s->qcow_version),
         .backing_file_offset    = 0,
         .backing_file_size      = 0,
         .cluster_bits           = cpu_to_be32(s->cluster_bits),
@@ -765,8 +1080,16 @@ int qcow2_update_header(BlockDriverState *bs)
         .snapshots_offset       = cpu_to_be64(s->snapshots_offset),
     };
 
-    buf += sizeof(*header);
-    buflen -= sizeof(*header);
+    if (s->qcow_version >= 3) {
+        header->incompatible_features   = cpu_to_be64(s->incompatible_features);
+        header->compatible_features     = cpu_to_be64(s->compatible_features);
+        header->autoclear_features      = cpu_to_be64(s->autoclear_features);
+        header->refcount_order          = cpu_to_be32(4);
+        header->header_length           = cpu_to_be32(header_length);
+    }
+
+    buf += header_length;
+    buflen -= header_length;
 
     /* Backing file format header extension */
     if (*bs->backing_format) {
@@ -898,7 +1221,7 @@ static int preallocate(BlockDriverState *bs)
 static int qcow2_create2(const char *filename, int64_t total_size,
                          const char *backing_file, const char *backing_format,
                          int flags, size_t cluster_size, int prealloc,
-                         QEMUOptionParameter *options)
+                         QEMUOptionParameter *options, int version)
 {
     /* Calculate cluster_bits */
     int cluster_bits;
@@ -942,7 +1265,7 @@ static int qcow2_create2(const char *filename, int64_t total_size,
     /* Write the header */
     memset(&header, 0, sizeof(header));
     header.magic = cpu_to_be32(QCOW_MAGIC);
-    header.version = cpu_to_be32(QCOW_VERSION);
+    header.version = cpu_to_be32(version);
     header.cluster_bits = cpu_to_be32(cluster_bits);
     header.size = cpu_to_be64(0);
     header.l1_table_offset = cpu_to_be64(0);
@@ -956,6 +1279,15 @@ static int qcow2_create2(const char *filename, int64_t total_size,
         header.crypt_method = cpu_to_be32(QCOW_CRYPT_NONE);
     }
 
+    if (version >= 3) {
+        header.refcount_order = cpu_to_be32(4);
+        header.header_length = cpu_to_be32(sizeof(header));
+        if (flags & BLOCK_FLAG_LAZY_REFCOUNTS) {
+            header.compatible_features =
+                cpu_to_be64(QCOW2_COMPAT_LAZY_REFCOUNTS);
+        }
+    }
+
     ret = bdrv_pwrite(bs, 0, &header, sizeof(header));
     if (ret < 0) {
         goto out;
@@ -1030,6 +1362,7 @@ static int qcow2_create(const char *filename, QEMUOptionParameter *options)
     int flags = 0;
     size_t cluster_size = DEFAULT_CLUSTER_SIZE;
     int prealloc = 0;
+    int version = 2;
 
     /* Read out options */
     while (options && options->name) {
@@ -1055,6 +1388,18 @@ static int qcow2_create(const char *filename, QEMUOptionParameter *options)
                     options->value.s);
                 return -EINVAL;
             }
+        } else if (!strcmp(options->name, BLOCK_OPT_COMPAT_LEVEL)) {
+            if (!options->value.s || !strcmp(options->value.s, "0.10")) {
+                version = 2;
+            } else if (!strcmp(options->value.s, "1.1")) {
+                version = 3;
+            } else {
+                fprintf(stderr, "Invalid compatibility level: '%s'\n",
+                    options->value.s);
+                return -EINVAL;
+            }
+        } else if (!strcmp(options->name, BLOCK_OPT_LAZY_REFCOUNTS)) {
+            flags |= options->value.n ? BLOCK_FLAG_LAZY_REFCOUNTS : 0;
         }
         options++;
     }
@@ -1065,8 +1410,14 @@ static int qcow2_create(const char *filename, QEMUOptionParameter *options)
         return -EINVAL;
     }
 
+    if (version < 3 && (flags & BLOCK_FLAG_LAZY_REFCOUNTS)) {
+        fprintf(stderr, "Lazy refcounts only supported with compatibility "
+                "level 1.1 and above (use compat=1.1 or greater)\n");
+        return -EINVAL;
+    }
+
     return qcow2_create2(filename, sectors, backing_file, backing_fmt, flags,
-                         cluster_size, prealloc, options);
+                         cluster_size, prealloc, options, version);
 }
 
 static int qcow2_make_empty(BlockDriverState *bs)
@@ -1139,14 +1490,53 @@ static int qcow2_truncate(BlockDriverState *bs, int64_t offset)
     return 0;
 }
 
-/* XXX: put compressed sectors first, then all the cluster aligned
-   tables to avoid losing bytes in alignment */
+static int qcow2_write_compressed_cluster(BlockDriverState *bs,
+    int64_t sector_num, const uint8_t *buf, const uint8_t *out_buf,
+    int out_len)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t cluster_offset;
+    int ret;
+
+    if (out_len == 0) {
+        /* could not compress: write normal cluster */
+        ret = bdrv_write(bs, sector_num, buf, s->cluster_sectors);
+        if (ret < 0) {
+            return ret;
+        }
+    } else {
+        cluster_offset = qcow2_alloc_compressed_cluster_offset(bs,
+            sector_num << 9, out_len);
+        if (!cluster_offset) {
+            return -EIO;
+        }
+        cluster_offset &= s->cluster_offset_mask;
+        BLKDBG_EVENT(bs->file, BLKDBG_WRITE_COMPRESSED);
+        ret = bdrv_pwrite(bs->file, cluster_offset, out_buf, out_len);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * nb_sectors may cover any number of whole clusters. The clusters are
+ * deflated in parallel by the zlib worker pool and written in order as
+ * their compression completes, so the layout of the image file is the same
+ * as if they had been written one at a time.
+ *
+ * XXX: put compressed sectors first, then all the cluster aligned
+ * tables to avoid losing bytes in alignment
+ */
 static int qcow2_write_compressed(BlockDriverState *bs, int64_t sector_num,
                                   const uint8_t *buf, int nb_sectors)
 {
     BDRVQcowState *s = bs->opaque;
-    z_stream strm;
-    int ret, out_len;
+    Qcow2ZPool *pool;
+    Qcow2ZJob *jobs;
+    int ret, i, nb_clusters;
     uint8_t *out_buf;
     uint64_t cluster_offset;
 
@@ -1159,59 +1549,41 @@ static int qcow2_write_compressed(BlockDriverState *bs, int64_t sector_num,
         return 0;
     }
 
-    if (nb_sectors != s->cluster_sectors)
+    if (nb_sectors % s->cluster_sectors)
         return -EINVAL;
 
-    out_buf = g_malloc(s->cluster_size + (s->cluster_size / 1000) + 128);
+    nb_clusters = nb_sectors / s->cluster_sectors;
+    pool = nb_clusters > 1 ? qcow2_zpool_get(bs) : NULL;
 
-    /* best compression, small window, no zlib header */
-    memset(&strm, 0, sizeof(strm));
-    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION,
-                       Z_DEFLATED, -12,
-                       9, Z_DEFAULT_STRATEGY);
-    if (ret != 0) {
-        ret = -EINVAL;
-        goto fail;
-    }
-
-    strm.avail_in = s->cluster_size;
-    strm.next_in = (uint8_t *)buf;
-    strm.avail_out = s->cluster_size;
-    strm.next_out = out_buf;
+    out_buf = g_malloc((size_t)nb_clusters * s->cluster_size);
+    jobs = g_malloc0(nb_clusters * sizeof(Qcow2ZJob));
 
-    ret = deflate(&strm, Z_FINISH);
-    if (ret != Z_STREAM_END && ret != Z_OK) {
-        deflateEnd(&strm);
-        ret = -EINVAL;
-        goto fail;
+    for (i = 0; i < nb_clusters; i++) {
+        jobs[i].compress = true;
+        jobs[i].in_buf = buf + (size_t)i * s->cluster_size;
+        jobs[i].in_len = s->cluster_size;
+        jobs[i].out_buf = out_buf + (size_t)i * s->cluster_size;
+        jobs[i].out_size = s->cluster_size;
+        qcow2_zpool_submit(pool, &jobs[i]);
     }
-    out_len = strm.next_out - out_buf;
 
-    deflateEnd(&strm);
-
-    if (ret != Z_STREAM_END || out_len >= s->cluster_size) {
-        /* could not compress: write normal cluster */
-        ret = bdrv_write(bs, sector_num, buf, s->cluster_sectors);
+    ret = 0;
+    for (i = 0; i < nb_clusters; i++) {
+        int out_len = qcow2_zpool_wait(pool, &jobs[i]);
         if (ret < 0) {
-            goto fail;
-        }
-    } else {
-        cluster_offset = qcow2_alloc_compressed_cluster_offset(bs,
-            sector_num << 9, out_len);
-        if (!cluster_offset) {
-            ret = -EIO;
-            goto fail;
+            /* drain the remaining jobs before freeing their buffers */
+            continue;
         }
-        cluster_offset &= s->cluster_offset_mask;
-        BLKDBG_EVENT(bs->file, BLKDBG_WRITE_COMPRESSED);
-        ret = bdrv_pwrite(bs->file, cluster_offset, out_buf, out_len);
-        if (ret < 0) {
-            goto fail;
+        if (out_len < 0) {
+            ret = out_len;
+            continue;
         }
+        ret = qcow2_write_compressed_cluster(bs,
+            sector_num + i * s->cluster_sectors,
+            jobs[i].in_buf, jobs[i].out_buf, out_len);
     }
 
-    ret = 0;
-fail:
+    g_free(jobs);
     g_free(out_buf);
     return ret;
 }
@@ -1259,7 +1631,7 @@ static int qcow2_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
 
 static int qcow2_check(BlockDriverState *bs, BdrvCheckResult *result)
 {
-    return qcow2_check_refcounts(bs, result);
+    return qcow2_check_refcounts(bs, result, false);
 }
 
 #if 0
@@ -1345,6 +1717,16 @@ static QEMUOptionParameter qcow2_create_options[] = {
         .type = OPT_STRING,
         .help = "Preallocation mode (allowed values: off, metadata)"
     },
+    {
+        .name = BLOCK_OPT_COMPAT_LEVEL,
+        .type = OPT_STRING,
+        .help = "Compatibility level (0.10 or 1.1)"
+    },
+    {
+        .name = BLOCK_OPT_LAZY_REFCOUNTS,
+        .type = OPT_FLAG,
+        .help = "Postpone refcount updates"
+    },
     { NULL }
 };
 
@@ -1381,6 +1763,7 @@ static BlockDriver bdrv_qcow2 = {
     .bdrv_change_backing_file   = qcow2_change_backing_file,
 
     .bdrv_invalidate_cache      = qcow2_invalidate_cache,
+    .bdrv_get_cache_stats       = qcow2_get_cache_stats,
 
     .create_options = qcow2_create_options,
     .bdrv_check = qcow2_check,
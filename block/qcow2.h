@@ -50,13 +50,41 @@
 #define MIN_CLUSTER_BITS 9
 #define MAX_CLUSTER_BITS 21
 
+/* Number of L2 tables cached by default.  The default grows with the image
+ * until the cache covers all of it or reaches DEFAULT_L2_CACHE_MAX bytes. */
 #define L2_CACHE_SIZE 16
+#define MIN_L2_CACHE_SIZE 2
+#define DEFAULT_L2_CACHE_MAX (8 * 1024 * 1024)
 
 /* Must be at least 4 to cover all cases of refcount table growth */
 #define REFCOUNT_CACHE_SIZE 4
 
+/* Upper limits for each metadata cache.  Lookups scan all entries, and all
+ * tables of a cache are allocated in one block. */
+#define QCOW2_MAX_CACHE_TABLES 4096
+#define QCOW2_MAX_CACHE_SIZE (256 * 1024 * 1024)
+
 #define DEFAULT_CLUSTER_SIZE 65536
 
+/* Upper limit for the zlib worker pool, which is sized after the host */
+#define QCOW2_MAX_COMPRESS_THREADS 64
+
+/* Maximum amount of guest data inflated at once by a multi-cluster read */
+#define QCOW2_MAX_DECOMPRESS_BATCH (8 * 1024 * 1024)
+
+typedef struct Qcow2ZPool Qcow2ZPool;
+
+typedef struct Qcow2ZJob {
+    bool compress;
+    const uint8_t *in_buf;
+    int in_len;
+    uint8_t *out_buf;
+    int out_size;
+    int ret;
+    bool done;
+    QSIMPLEQ_ENTRY(Qcow2ZJob) next;
+} Qcow2ZJob;
+
 typedef struct QCowHeader {
     uint32_t magic;
     uint32_t version;
@@ -71,8 +99,26 @@ typedef struct QCowHeader {
     uint32_t refcount_table_clusters;
     uint32_t nb_snapshots;
     uint64_t snapshots_offset;
+
+    /* The following fields are only valid for version >= 3 */
+    uint64_t incompatible_features;
+    uint64_t compatible_features;
+    uint64_t autoclear_features;
+
+    uint32_t refcount_order;
+    uint32_t header_length;
 } QCowHeader;
 
+/* Length of the header of version 2 images, which ends before the features */
+#define QCOW2_V2_HEADER_LENGTH offsetof(QCowHeader, incompatible_features)
+
+/* Incompatible feature bits: images with unknown bits set can't be opened */
+#define QCOW2_INCOMPAT_DIRTY        (1ULL << 0)
+#define QCOW2_INCOMPAT_MASK         QCOW2_INCOMPAT_DIRTY
+
+/* Compatible feature bits: unknown bits can be ignored */
+#define QCOW2_COMPAT_LAZY_REFCOUNTS (1ULL << 0)
+
 typedef struct QCowSnapshot {
     uint64_t l1_table_offset;
     uint32_t l1_size;
@@ -110,10 +156,14 @@ typedef struct BDRVQcowState {
 
     Qcow2Cache* l2_table_cache;
     Qcow2Cache* refcount_block_cache;
+    QEMUTimer *cache_clean_timer;
+    Coroutine *cache_clean_co;
+    int64_t cache_clean_interval;
 
     uint8_t *cluster_cache;
     uint8_t *cluster_data;
     uint64_t cluster_cache_offset;
+    Qcow2ZPool *zpool;
     QLIST_HEAD(QCowClusterAlloc, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
@@ -134,6 +184,13 @@ typedef struct BDRVQcowState {
     QCowSnapshot *snapshots;
 
     int flags;
+    int qcow_version;
+    bool use_lazy_refcounts;
+
+    uint64_t incompatible_features;
+    uint64_t compatible_features;
+    uint64_t autoclear_features;
+
     QLIST_HEAD(, Qcow2UnknownHeaderExtension) unknown_header_ext;
 } BDRVQcowState;
 
@@ -187,6 +244,7 @@ static inline int64_t align_offset(int64_t offset, int n)
 int qcow2_backing_read1(BlockDriverState *bs, QEMUIOVector *qiov,
                   int64_t sector_num, int nb_sectors);
 int qcow2_update_header(BlockDriverState *bs);
+int qcow2_mark_dirty(BlockDriverState *bs);
 
 /* qcow2-refcount.c functions */
 int qcow2_refcount_init(BlockDriverState *bs);
@@ -202,12 +260,15 @@ void qcow2_free_any_clusters(BlockDriverState *bs,
 int qcow2_update_snapshot_refcount(BlockDriverState *bs,
     int64_t l1_table_offset, int l1_size, int addend);
 
-int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res);
+int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
+                          bool repair);
 
 /* qcow2-cluster.c functions */
 int qcow2_grow_l1_table(BlockDriverState *bs, int min_size, bool exact_size);
 void qcow2_l2_cache_reset(BlockDriverState *bs);
 int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t cluster_offset);
+int qcow2_decompress_clusters(BlockDriverState *bs, uint64_t offset,
+    uint64_t cluster_offset, int nb_clusters, uint8_t *buf);
 void qcow2_encrypt_sectors(BDRVQcowState *s, int64_t sector_num,
                      uint8_t *out_buf, const uint8_t *in_buf,
                      int nb_sectors, int enc,
@@ -235,6 +296,16 @@ int qcow2_snapshot_load_tmp(BlockDriverState *bs, const char *snapshot_name);
 void qcow2_free_snapshots(BlockDriverState *bs);
 int qcow2_read_snapshots(BlockDriverState *bs);
 
+/* qcow2-compress.c functions */
+int qcow2_compress_buffer(uint8_t *out_buf, int out_size,
+                          const uint8_t *buf, int in_len);
+int qcow2_decompress_buffer(uint8_t *out_buf, int out_buf_size,
+                            const uint8_t *buf, int buf_size);
+Qcow2ZPool *qcow2_zpool_get(BlockDriverState *bs);
+void qcow2_zpool_destroy(Qcow2ZPool *pool);
+void qcow2_zpool_submit(Qcow2ZPool *pool, Qcow2ZJob *job);
+int qcow2_zpool_wait(Qcow2ZPool *pool, Qcow2ZJob *job);
+
 /* qcow2-cache.c functions */
 Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     bool writethrough);
@@ -244,6 +315,7 @@ bool qcow2_cache_set_writethrough(BlockDriverState *bs, Qcow2Cache *c,
 
 void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table);
 int qcow2_cache_flush(BlockDriverState *bs, Qcow2Cache *c);
+int qcow2_cache_clean(BlockDriverState *bs, Qcow2Cache *c);
 int qcow2_cache_set_dependency(BlockDriverState *bs, Qcow2Cache *c,
     Qcow2Cache *dependency);
 void qcow2_cache_depends_on_flush(Qcow2Cache *c);
@@ -253,5 +325,6 @@ int qcow2_cache_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table);
 int qcow2_cache_put(BlockDriverState *bs, Qcow2Cache *c, void **table);
+BlockCacheStats *qcow2_cache_get_stats(Qcow2Cache *c, const char *name);
 
 #endif
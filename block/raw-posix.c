@@ -616,6 +616,53 @@ static coroutine_fn int raw_co_discard(BlockDriverState *bs,
     return 0;
 }
 
+/*
+ * Holes in sparse files read as zeroes, so they are reported as unallocated.
+ * Without SEEK_DATA/SEEK_HOLE support everything counts as allocated.
+ */
+static int coroutine_fn raw_co_is_allocated(BlockDriverState *bs,
+    int64_t sector_num, int nb_sectors, int *pnum)
+{
+#ifdef SEEK_DATA
+    BDRVRawState *s = bs->opaque;
+    off_t start, data, hole;
+    int64_t n;
+
+    start = sector_num * BDRV_SECTOR_SIZE;
+
+    hole = lseek(s->fd, start, SEEK_HOLE);
+    if (hole == -1) {
+        /* Most likely EINVAL, the file system doesn't support holes */
+        *pnum = nb_sectors;
+        return 1;
+    }
+
+    if (hole > start) {
+        /* On a data extent, count sectors up to the next hole */
+        n = DIV_ROUND_UP(hole - start, BDRV_SECTOR_SIZE);
+        *pnum = MIN(nb_sectors, n);
+        return 1;
+    }
+
+    /* On a hole, count sectors up to the next data extent or the end of the
+     * file */
+    data = lseek(s->fd, start, SEEK_DATA);
+    if (data == -1) {
+        data = lseek(s->fd, 0, SEEK_END);
+    }
+    n = (data - start) / BDRV_SECTOR_SIZE;
+    if (n <= 0) {
+        *pnum = 1;
+        return 1;
+    }
+    *pnum = MIN(nb_sectors, n);
+    return 0;
+#else
+    *pnum = nb_sectors;
+    return 1;
+#endif
+}
+
 static QEMUOptionParameter raw_create_options[] = {
     {
         .name = BLOCK_OPT_SIZE,
@@ -634,6 +681,7 @@ static BlockDriver bdrv_file = {
     .bdrv_close = raw_close,
     .bdrv_create = raw_create,
     .bdrv_co_discard = raw_co_discard,
+    .bdrv_co_is_allocated = raw_co_is_allocated,
 
     .bdrv_aio_readv = raw_aio_readv,
     .bdrv_aio_writev = raw_aio_writev,
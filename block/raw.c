@@ -21,6 +21,13 @@ static int coroutine_fn raw_co_writev(BlockDriverState *bs, int64_t sector_num,
     return bdrv_co_writev(bs->file, sector_num, nb_sectors, qiov);
 }
 
+static int coroutine_fn raw_co_is_allocated(BlockDriverState *bs,
+                                           int64_t sector_num,
+                                           int nb_sectors, int *pnum)
+{
+    return bdrv_co_is_allocated(bs->file, sector_num, nb_sectors, pnum);
+}
+
 static void raw_close(BlockDriverState *bs)
 {
 }
@@ -115,6 +122,7 @@ static BlockDriver bdrv_raw = {
     .bdrv_co_writev         = raw_co_writev,
     .bdrv_co_flush_to_disk  = raw_co_flush,
     .bdrv_co_discard        = raw_co_discard,
+    .bdrv_co_is_allocated   = raw_co_is_allocated,
 
     .bdrv_probe         = raw_probe,
     .bdrv_getlength     = raw_getlength,
@@ -33,6 +33,7 @@
 
 #define BLOCK_FLAG_ENCRYPT	1
 #define BLOCK_FLAG_COMPAT6	4
+#define BLOCK_FLAG_LAZY_REFCOUNTS 8
 
 #define BLOCK_IO_LIMIT_READ     0
 #define BLOCK_IO_LIMIT_WRITE    1
@@ -50,6 +51,8 @@
 #define BLOCK_OPT_TABLE_SIZE    "table_size"
 #define BLOCK_OPT_PREALLOC      "preallocation"
 #define BLOCK_OPT_SUBFMT        "subformat"
+#define BLOCK_OPT_COMPAT_LEVEL  "compat"
+#define BLOCK_OPT_LAZY_REFCOUNTS "lazy_refcounts"
 
 typedef struct BdrvTrackedRequest BdrvTrackedRequest;
 
@@ -69,6 +72,13 @@ typedef struct BlockIOBaseValue {
     uint64_t ios[2];
 } BlockIOBaseValue;
 
+/* Sizes of format driver metadata caches; 0 means the driver default */
+typedef struct BlockCacheConfig {
+    int64_t l2_size;            /* bytes */
+    int64_t refcount_size;      /* bytes */
+    int64_t clean_interval;     /* seconds between background writebacks */
+} BlockCacheConfig;
+
 typedef void BlockJobCancelFunc(void *opaque);
 typedef struct BlockJob BlockJob;
 typedef struct BlockJobType {
@@ -224,6 +234,9 @@ struct BlockDriver {
      */
     int (*bdrv_has_zero_init)(BlockDriverState *bs);
 
+    /* Statistics of the driver's metadata caches, for "info blockstats" */
+    BlockCacheStatsList *(*bdrv_get_cache_stats)(BlockDriverState *bs);
+
     QLIST_ENTRY(BlockDriver) list;
 };
 
@@ -273,6 +286,9 @@ struct BlockDriverState {
     QEMUTimer    *block_timer;
     bool         io_limits_enabled;
 
+    /* metadata cache sizing requested for the format driver */
+    BlockCacheConfig cache_config;
+
     /* I/O stats (display with "info blockstats"). */
     uint64_t nr_bytes[BDRV_MAX_IOTYPE];
     uint64_t nr_ops[BDRV_MAX_IOTYPE];
@@ -323,6 +339,8 @@ void qemu_aio_release(void *p);
 
 void bdrv_set_io_limits(BlockDriverState *bs,
                         BlockIOLimit *io_limits);
+void bdrv_set_cache_config(BlockDriverState *bs,
+                           BlockCacheConfig *cache_config);
 
 #ifdef _WIN32
 int is_windows_drive(const char *filename);
@@ -291,6 +291,7 @@ DriveInfo *drive_init(QemuOpts *opts, int default_to_scsi)
     const char *devaddr;
     DriveInfo *dinfo;
     BlockIOLimit io_limits;
+    BlockCacheConfig cache_config;
     int snapshot = 0;
     bool copy_on_read;
     int ret;
@@ -431,6 +432,13 @@ DriveInfo *drive_init(QemuOpts *opts, int default_to_scsi)
         return NULL;
     }
 
+    /* format driver metadata caches */
+    cache_config.l2_size = qemu_opt_get_size(opts, "l2-cache-size", 0);
+    cache_config.refcount_size =
+                           qemu_opt_get_size(opts, "refcount-cache-size", 0);
+    cache_config.clean_interval =
+                           qemu_opt_get_number(opts, "cache-clean-interval", 0);
+
     on_write_error = BLOCK_ERR_STOP_ENOSPC;
     if ((buf = qemu_opt_get(opts, "werror")) != NULL) {
         if (type != IF_IDE && type != IF_SCSI && type != IF_VIRTIO && type != IF_NONE) {
@@ -541,6 +549,8 @@ DriveInfo *drive_init(QemuOpts *opts, int default_to_scsi)
     /* disk I/O throttling */
     bdrv_set_io_limits(dinfo->bdrv, &io_limits);
 
+    bdrv_set_cache_config(dinfo->bdrv, &cache_config);
+
     switch(type) {
     case IF_IDE:
     case IF_SCSI:
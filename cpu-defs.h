@@ -67,7 +67,15 @@ typedef uint64_t target_ulong __attribute__((aligned(TARGET_LONG_ALIGNMENT)));
 #define EXCP_DEBUG      0x10002 /* cpu stopped after a breakpoint or singlestep */
 #define EXCP_HALTED     0x10003 /* cpu is halted (waiting for external event) */
 
-#define TB_JMP_CACHE_BITS 12
+/* The per-CPU virtual PC -> TB cache has 1 << tb_jmp_cache_bits entries.
+   The size is chosen at startup (-tb-jmp-cache-bits, QEMU_TB_JMP_CACHE_BITS
+   in user mode) and must be set before the first CPU is created.  */
+#define TB_JMP_CACHE_BITS_DEFAULT 12
+#define TB_JMP_CACHE_BITS_MIN 8
+#define TB_JMP_CACHE_BITS_MAX 20
+extern unsigned int tb_jmp_cache_bits;
+
+#define TB_JMP_CACHE_BITS tb_jmp_cache_bits
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
 /* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
@@ -110,10 +118,27 @@ typedef struct CPUTLBEntry {
 
 extern int CPUTLBEntry_wrong_size[sizeof(CPUTLBEntry) == (1 << CPU_TLB_ENTRY_BITS) ? 1 : -1];
 
+/* Entries evicted from tlb_table are kept in a small fully associative
+   victim TLB which is searched before calling tlb_fill.  The generated
+   code only knows about tlb_table, so unlike it the victim TLB can be
+   resized at run time: each MMU mode uses CPU_VTLB_MIN_SIZE << vtlb_shift
+   entries, adjusted every CPU_VTLB_RESIZE_WINDOW misses.  */
+#define CPU_VTLB_MIN_BITS 3
+#define CPU_VTLB_MAX_BITS 6
+#define CPU_VTLB_MIN_SIZE (1 << CPU_VTLB_MIN_BITS)
+#define CPU_VTLB_MAX_SIZE (1 << CPU_VTLB_MAX_BITS)
+#define CPU_VTLB_RESIZE_WINDOW 1024
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
     CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
     target_phys_addr_t iotlb[NB_MMU_MODES][CPU_TLB_SIZE];               \
+    CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_MAX_SIZE];           \
+    target_phys_addr_t iotlb_v[NB_MMU_MODES][CPU_VTLB_MAX_SIZE];        \
+    uint8_t vtlb_shift[NB_MMU_MODES]; /* victim TLB size, see above */  \
+    uint16_t vtlb_next[NB_MMU_MODES]; /* next victim slot to replace */ \
+    uint16_t vtlb_misses[NB_MMU_MODES]; /* misses in resize window */   \
+    uint16_t vtlb_hits[NB_MMU_MODES]; /* victim hits in window */       \
     target_ulong tlb_flush_addr;                                        \
     target_ulong tlb_flush_mask;
 
@@ -176,7 +201,6 @@ typedef struct CPUWatchpoint {
     uint32_t interrupt_request;                                         \
     volatile sig_atomic_t exit_request;                                 \
     CPU_COMMON_TLB                                                      \
-    struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];           \
     /* buffer for temporaries in the code generator */                  \
     long temp_buf[CPU_TEMP_BUF_NLONGS];                                 \
                                                                         \
@@ -204,6 +228,9 @@ typedef struct CPUWatchpoint {
     jmp_buf jmp_env;                                                    \
     int exception_index;                                                \
                                                                         \
+    /* virtual PC -> TB cache, TB_JMP_CACHE_SIZE entries */             \
+    struct TranslationBlock **tb_jmp_cache;                             \
+                                                                        \
     CPUState *next_cpu; /* next CPU sharing TB cache */                 \
     int cpu_index; /* CPU index (informative) */                        \
     uint32_t host_tid; /* host thread ID */                             \
@@ -23,6 +23,12 @@
 #include "qemu-barrier.h"
 
 int tb_invalidated_flag;
+uint64_t tb_lookup_ptr_count;
+uint64_t tb_lookup_ptr_miss_count;
+#ifdef CONFIG_PROFILER
+uint64_t tb_jmp_cache_lookup_count;
+uint64_t tb_jmp_cache_miss_count;
+#endif
 
 //#define CONFIG_DEBUG_EXEC
 
@@ -84,57 +90,62 @@ static TranslationBlock *tb_find_slow(CPUState *env,
                                       target_ulong cs_base,
                                       uint64_t flags)
 {
-    TranslationBlock *tb, **ptb1;
-    unsigned int h;
-    tb_page_addr_t phys_pc, phys_page1;
-    target_ulong virt_page2;
+    TranslationBlock *tb;
+    tb_page_addr_t phys_pc;
 
     tb_invalidated_flag = 0;
 
     /* find translated block using physical mappings */
     phys_pc = get_page_addr_code(env, pc);
-    phys_page1 = phys_pc & TARGET_PAGE_MASK;
-    h = tb_phys_hash_func(phys_pc);
-    ptb1 = &tb_phys_hash[h];
-    for(;;) {
-        tb = *ptb1;
-        if (!tb)
-            goto not_found;
-        if (tb->pc == pc &&
-            tb->page_addr[0] == phys_page1 &&
-            tb->cs_base == cs_base &&
-            tb->flags == flags) {
-            /* check next page if needed */
-            if (tb->page_addr[1] != -1) {
-                tb_page_addr_t phys_page2;
-
-                virt_page2 = (pc & TARGET_PAGE_MASK) +
-                    TARGET_PAGE_SIZE;
-                phys_page2 = get_page_addr_code(env, virt_page2);
-                if (tb->page_addr[1] == phys_page2)
-                    goto found;
-            } else {
-                goto found;
-            }
-        }
-        ptb1 = &tb->phys_hash_next;
-    }
- not_found:
-   /* if no translated code available, then translate it now */
-    tb = tb_gen_code(env, pc, cs_base, flags, 0);
-
- found:
-    /* Move the last found TB to the head of the list */
-    if (likely(*ptb1)) {
-        *ptb1 = tb->phys_hash_next;
-        tb->phys_hash_next = tb_phys_hash[h];
-        tb_phys_hash[h] = tb;
+    tb = tb_hash_lookup(env, phys_pc, pc, cs_base, flags);
+    if (!tb) {
+        /* if no translated code available, then translate it now */
+        tb = tb_gen_code(env, pc, cs_base, flags, 0);
     }
     /* we add the TB in the virtual pc hash table */
     env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)] = tb;
     return tb;
 }
 
+/* Called by the generated code at an indirect branch, once the new PC
+   has been stored.  Return the host code of the TB for the current CPU
+   state if it is in the jump cache, so that execution stays in
+   translated code.  Otherwise return the TCG epilogue, which goes back
+   to cpu_exec() without chaining; that is also done for pending
+   interrupts and exit requests, and when the current TB was generated
+   with an instruction count (cpu_exec_nocache, IO recompile, SMC).  */
+void *tb_lookup_ptr(CPUState *env)
+{
+    TranslationBlock *tb;
+    target_ulong cs_base, pc;
+    int flags;
+
+    tb_lookup_ptr_count++;
+    tb = env->current_tb;
+    if (unlikely(!tb || (tb->cflags & CF_COUNT_MASK))) {
+        goto miss;
+    }
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    tb = env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
+    if (unlikely(!tb || tb->pc != pc || tb->cs_base != cs_base ||
+                 tb->flags != flags)) {
+        goto miss;
+    }
+    /* Same protocol as cpu_exec(): cpu_interrupt() unlinks the jumps of
+       env->current_tb, so publish the new TB before checking for
+       pending requests.  */
+    env->current_tb = tb;
+    barrier();
+    if (unlikely(env->interrupt_request || env->exit_request)) {
+        goto miss;
+    }
+    return tb->tc_ptr;
+
+ miss:
+    tb_lookup_ptr_miss_count++;
+    return tcg_ctx.code_gen_epilogue;
+}
+
 static inline TranslationBlock *tb_find_fast(CPUState *env)
 {
     TranslationBlock *tb;
@@ -145,9 +156,15 @@ static inline TranslationBlock *tb_find_fast(CPUState *env)
        always be the same before a given translated block
        is executed. */
     cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+#ifdef CONFIG_PROFILER
+    tb_jmp_cache_lookup_count++;
+#endif
     tb = env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
     if (unlikely(!tb || tb->pc != pc || tb->cs_base != cs_base ||
                  tb->flags != flags)) {
+#ifdef CONFIG_PROFILER
+        tb_jmp_cache_miss_count++;
+#endif
         tb = tb_find_slow(env, pc, cs_base, flags);
     }
     return tb;
@@ -532,6 +549,11 @@ int cpu_exec(CPUState *env)
 #endif /* DEBUG_DISAS || CONFIG_DEBUG_EXEC */
                 spin_lock(&tb_lock);
                 tb = tb_find_fast(env);
+                if (unlikely(tb_profile_hot_samples &&
+                             tb->prof_samples >= tb_profile_hot_samples &&
+                             tb->cflags == 0)) {
+                    tb = tb_gen_hot_code(env, tb);
+                }
                 /* Note: we do it here to avoid a gcc bug on Mac OS X when
                    doing it in tb_find_slow */
                 if (tb_invalidated_flag) {
@@ -548,8 +570,12 @@ int cpu_exec(CPUState *env)
 #endif
                 /* see if we can patch the calling TB. When the TB
                    spans two pages, we cannot safely do a direct
-                   jump. */
-                if (next_tb != 0 && tb->page_addr[1] == -1) {
+                   jump. TBs of self modifying code are not chained
+                   either. */
+                if (next_tb != 0 && tb->page_addr[1] == -1 &&
+                    !(tb->cflags & CF_NOCHAIN) &&
+                    !(((TranslationBlock *)(next_tb & ~3))->cflags &
+                      CF_NOCHAIN)) {
                     tb_add_jump((TranslationBlock *)(next_tb & ~3), next_tb & 3, tb);
                 }
                 spin_unlock(&tb_lock);
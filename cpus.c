@@ -578,6 +578,8 @@ static void qemu_tcg_init_cpu_signals(void)
 
     sigemptyset(&set);
     sigaddset(&set, SIG_IPI);
+    /* let the JIT profiler sample the threads that run translated code */
+    sigaddset(&set, SIGPROF);
     pthread_sigmask(SIG_UNBLOCK, &set, NULL);
 }
 
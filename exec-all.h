@@ -68,6 +68,20 @@ typedef struct TranslationBlock TranslationBlock;
    a couple of fixup instructions per argument.  */
 #define TCG_MAX_OP_SIZE 192
 
+/* Target state at the start of each guest instruction, beyond the PC,
+   that restore_state_to_opc() uses.  Targets with such state define
+   TARGET_INSN_EXTRA_WORDS in cpu.h and convert it to and from words
+   with save_opc_extra() and load_opc_extra(). */
+#ifndef TARGET_INSN_EXTRA_WORDS
+#define TARGET_INSN_EXTRA_WORDS 0
+#endif
+
+/* Upper bound for the size of the PC mapping table of a TB: per guest
+   instruction one LEB128 host offset of at most 3 bytes and at most 10
+   bytes for the PC, the instruction count and each extra word. */
+#define TB_PC_MAP_MAX_SIZE \
+    (OPC_BUF_SIZE * (3 + 10 * (2 + TARGET_INSN_EXTRA_WORDS)))
+
 #define OPPARAM_BUF_SIZE (OPC_BUF_SIZE * MAX_OPC_PARAM)
 
 extern target_ulong gen_opc_pc[OPC_BUF_SIZE];
@@ -80,12 +94,17 @@ void gen_intermediate_code(CPUState *env, struct TranslationBlock *tb);
 void gen_intermediate_code_pc(CPUState *env, struct TranslationBlock *tb);
 void restore_state_to_opc(CPUState *env, struct TranslationBlock *tb,
                           int pc_pos);
+#if TARGET_INSN_EXTRA_WORDS > 0
+void save_opc_extra(target_ulong *extra, int pc_pos);
+void load_opc_extra(const target_ulong *extra, int pc_pos);
+#endif
 
 void cpu_gen_init(void);
 int cpu_gen_code(CPUState *env, struct TranslationBlock *tb,
                  int *gen_code_size_ptr);
 int cpu_restore_state(struct TranslationBlock *tb,
                       CPUState *env, unsigned long searched_pc);
+int tb_pc_map_size(struct TranslationBlock *tb);
 void cpu_resume_from_signal(CPUState *env1, void *puc);
 void cpu_io_recompile(CPUState *env, void *retaddr);
 TranslationBlock *tb_gen_code(CPUState *env, 
@@ -109,8 +128,16 @@ void tlb_set_page(CPUState *env, target_ulong vaddr,
 #define CODE_GEN_PHYS_HASH_BITS     15
 #define CODE_GEN_PHYS_HASH_SIZE     (1 << CODE_GEN_PHYS_HASH_BITS)
 
+/* initial number of slots of the physical TB hash table; it doubles
+   whenever it becomes half full */
+#define TB_HASH_INITIAL_BITS        12
+
 #define MIN_CODE_GEN_BUFFER_SIZE     (1024 * 1024)
 
+/* when the code buffer is full, the oldest 1/CODE_GEN_EVICT_REGIONS of
+   it is invalidated instead of flushing all translated code */
+#define CODE_GEN_EVICT_REGIONS       8
+
 /* estimated block size for TB allocation */
 /* XXX: use a per code average code fragment size and modulate it
    according to the host CPU */
@@ -133,11 +160,15 @@ struct TranslationBlock {
     uint16_t size;      /* size of target code for this block (1 <=
                            size <= TARGET_PAGE_SIZE) */
     uint16_t cflags;    /* compile flags */
-#define CF_COUNT_MASK  0x7fff
+#define CF_COUNT_MASK  0x1fff
+#define CF_HOT         0x2000 /* Retranslated hot TB, fully optimized.  */
+#define CF_NOCHAIN     0x4000 /* Never chain to or from this TB.  */
 #define CF_LAST_IO     0x8000 /* Last insn may be an IO access.  */
+    uint16_t pc_map_offset; /* offset of the PC mapping table from tc_ptr,
+                               0 if there is none */
 
     uint8_t *tc_ptr;    /* pointer to the translated code */
-    /* next matching tb for physical address. */
+    /* next dormant TB in the same translation cache bucket */
     struct TranslationBlock *phys_hash_next;
     /* first and second physical page containing code. The lower bit
        of the pointer tells the index in page_next[] */
@@ -159,6 +190,8 @@ struct TranslationBlock {
     struct TranslationBlock *jmp_next[2];
     struct TranslationBlock *jmp_first;
     uint32_t icount;
+    /* number of JIT profiler samples that hit the code of this TB */
+    uint32_t prof_samples;
 };
 
 static inline unsigned int tb_jmp_cache_hash_page(target_ulong pc)
@@ -187,7 +220,9 @@ void tb_link_page(TranslationBlock *tb,
                   tb_page_addr_t phys_pc, tb_page_addr_t phys_page2);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
 
-extern TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
+TranslationBlock *tb_hash_lookup(CPUState *env, tb_page_addr_t phys_pc,
+                                 target_ulong pc, target_ulong cs_base,
+                                 uint64_t flags);
 
 #if defined(USE_DIRECT_JUMP)
 
@@ -272,11 +307,32 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
 
 TranslationBlock *tb_find_pc(unsigned long pc_ptr);
 
+#if defined(CONFIG_USER_ONLY)
+void tb_cache_load(const char *filename, const char *key);
+void tb_cache_save(void);
+#endif
+
+extern int tb_perf_map_enabled;
+void tb_perf_map_flush(void);
+
+extern int tb_profile_hz;
+extern unsigned int tb_profile_hot_samples;
+void tb_profile_save(void);
+TranslationBlock *tb_gen_hot_code(CPUState *env, TranslationBlock *tb);
+
 #include "qemu-lock.h"
 
 extern spinlock_t tb_lock;
 
 extern int tb_invalidated_flag;
+extern uint64_t tb_lookup_ptr_count;
+extern uint64_t tb_lookup_ptr_miss_count;
+#ifdef CONFIG_PROFILER
+extern uint64_t tb_jmp_cache_lookup_count;
+extern uint64_t tb_jmp_cache_miss_count;
+#endif
+
+void *tb_lookup_ptr(CPUState *env);
 
 /* The return address may point to the start of the next instruction.
    Subtracting one gets us the call instruction itself.  */
@@ -306,6 +362,8 @@ extern struct MemoryRegion *io_mem_region[IO_MEM_NB_ENTRIES];
 
 void tlb_fill(CPUState *env1, target_ulong addr, int is_write, int mmu_idx,
               void *retaddr);
+bool tlb_victim_hit(CPUState *env1, target_ulong addr, int mmu_idx,
+                    int index, int access_type);
 
 #include "softmmu_defs.h"
 
@@ -22,11 +22,13 @@
 #else
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #endif
 
 #include "qemu-common.h"
 #include "cpu.h"
 #include "tcg.h"
+#include "disas.h"
 #include "hw/hw.h"
 #include "hw/qdev.h"
 #include "osdep.h"
@@ -79,10 +81,40 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+/* Adaptive self modifying code handling.  Every time a guest write
+   invalidates translated code, the page counts it and remembers which of
+   its 64 lines was written.  Once a page has seen SMC_DEMOTE_THRESHOLD
+   such writes, new TBs starting in a written line hold one guest
+   instruction and are never chained: later writes then only invalidate
+   the instructions they really hit, and the invalidation does not have
+   to unlink any jumps.  This only applies to system emulation: in user
+   mode code pages are write protected as a whole and the first write
+   invalidates all the code of the page anyway. */
+#define SMC_DEMOTE_THRESHOLD 16
+#define SMC_LINE_SHIFT (TARGET_PAGE_BITS - 6)
+
+/* tbs[] is used as a ring: the nb_tbs live TBs start at tbs[tb_first]
+   in allocation order, which is also the order of their code in the
+   (circular) code_gen_buffer.  */
 static TranslationBlock *tbs;
 static int code_gen_max_blocks;
-TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
+/* Physical TB hash table, keyed on (phys_pc, pc, flags).  It uses open
+   addressing with linear probing; each slot also holds the hash of its
+   TB so that most mismatches are rejected without touching the TB.  */
+typedef struct TBHashSlot {
+    uint32_t hash;
+    TranslationBlock *tb;
+} TBHashSlot;
+
+static TBHashSlot *tb_hash_table;
+static unsigned int tb_hash_bits;
+static unsigned int tb_hash_mask;
+static unsigned int tb_hash_count;
+unsigned int tb_jmp_cache_bits = TB_JMP_CACHE_BITS_DEFAULT;
+
+static void tb_hash_resize(unsigned int bits);
 static int nb_tbs;
+static int tb_first;
 /* any access to the tbs or the page table must use this lock */
 spinlock_t tb_lock = SPIN_LOCK_UNLOCKED;
 
@@ -108,6 +140,10 @@ static unsigned long code_gen_buffer_size;
 /* threshold to flush the translated code buffer */
 static unsigned long code_gen_buffer_max_size;
 static uint8_t *code_gen_ptr;
+/* end of the generated code when code_gen_ptr has wrapped around */
+static uint8_t *code_gen_wrap_end;
+/* amount of code evicted at once when the buffer is full */
+static unsigned long code_gen_evict_size;
 
 #if !defined(CONFIG_USER_ONLY)
 int phys_ram_fd;
@@ -139,6 +175,10 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned int code_write_count;
     uint8_t *code_bitmap;
+    /* number of code invalidations by guest writes and the lines they
+       hit, see SMC_DEMOTE_THRESHOLD */
+    unsigned int smc_count;
+    uint64_t smc_lines;
 #if defined(CONFIG_USER_ONLY)
     unsigned long flags;
 #endif
@@ -226,9 +266,25 @@ static int log_append = 0;
 /* statistics */
 #if !defined(CONFIG_USER_ONLY)
 static int tlb_flush_count;
+static int tlb_miss_count;
+static int tlb_victim_hit_count;
+static int tlb_victim_resize_count;
 #endif
 static int tb_flush_count;
 static int tb_phys_invalidate_count;
+static int tb_evict_region_count;
+static int tb_evict_count;
+static int smc_invalidate_count;
+static int smc_demoted_page_count;
+static int smc_tb_count;
+static int tb_hash_resize_count;
+static uint64_t tb_hash_lookup_count;
+static uint64_t tb_hash_miss_count;
+static uint64_t tb_hash_probe_count;
+static unsigned int tb_hash_max_probes;
+#ifdef CONFIG_PROFILER
+static int64_t tb_hash_lookup_time;
+#endif
 
 #ifdef _WIN32
 static void map_exec(void *addr, long size)
@@ -471,6 +527,10 @@ static void tlb_unprotect_code_phys(CPUState *env, ram_addr_t ram_addr,
 #ifdef USE_STATIC_CODE_GEN_BUFFER
 static uint8_t static_code_gen_buffer[DEFAULT_CODE_GEN_BUFFER_SIZE]
                __attribute__((aligned (CODE_GEN_ALIGN)));
+/* Generated code embeds the address of its TranslationBlock, so keep
+   tbs[] at a fixed address too; the translation cache relies on it. */
+static TranslationBlock static_tbs[DEFAULT_CODE_GEN_BUFFER_SIZE /
+                                   CODE_GEN_AVG_BLOCK_SIZE];
 #endif
 
 static void code_gen_alloc(unsigned long tb_size)
@@ -568,9 +628,14 @@ static void code_gen_alloc(unsigned long tb_size)
 #endif /* !USE_STATIC_CODE_GEN_BUFFER */
     map_exec(code_gen_prologue, sizeof(code_gen_prologue));
     code_gen_buffer_max_size = code_gen_buffer_size -
-        (TCG_MAX_OP_SIZE * OPC_BUF_SIZE);
+        (TCG_MAX_OP_SIZE * OPC_BUF_SIZE + TB_PC_MAP_MAX_SIZE);
+    code_gen_evict_size = code_gen_buffer_size / CODE_GEN_EVICT_REGIONS;
     code_gen_max_blocks = code_gen_buffer_size / CODE_GEN_AVG_BLOCK_SIZE;
+#ifdef USE_STATIC_CODE_GEN_BUFFER
+    tbs = static_tbs;
+#else
     tbs = g_malloc(code_gen_max_blocks * sizeof(TranslationBlock));
+#endif
 }
 
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
@@ -580,6 +645,7 @@ void tcg_exec_init(unsigned long tb_size)
 {
     cpu_gen_init();
     code_gen_alloc(tb_size);
+    tb_hash_resize(TB_HASH_INITIAL_BITS);
     code_gen_ptr = code_gen_buffer;
     page_init();
 #if !defined(CONFIG_USER_ONLY) || !defined(CONFIG_USE_GUEST_BASE)
@@ -660,6 +726,8 @@ void cpu_exec_init(CPUState *env)
     }
     env->cpu_index = cpu_index;
     env->numa_node = 0;
+    env->tb_jmp_cache = g_malloc0(TB_JMP_CACHE_SIZE *
+                                  sizeof(*env->tb_jmp_cache));
     QTAILQ_INIT(&env->breakpoints);
     QTAILQ_INIT(&env->watchpoints);
 #ifndef CONFIG_USER_ONLY
@@ -676,18 +744,73 @@ void cpu_exec_init(CPUState *env)
 #endif
 }
 
-/* Allocate a new translation block. Flush the translation buffer if
-   too many translation blocks or too much generated code. */
+#if defined(CONFIG_USER_ONLY)
+static void tb_cache_discard(void);
+static TranslationBlock *tb_cache_lookup(target_ulong pc, target_ulong cs_base,
+                                         uint64_t flags);
+#endif
+
+static inline TranslationBlock *tb_nth(int n)
+{
+    n += tb_first;
+    if (n >= code_gen_max_blocks) {
+        n -= code_gen_max_blocks;
+    }
+    return &tbs[n];
+}
+
+/* Offset of 'tc_ptr' from 'origin' in the circular code buffer.  */
+static inline unsigned long tb_code_offset(uint8_t *origin, uint8_t *tc_ptr)
+{
+    if (tc_ptr >= origin) {
+        return tc_ptr - origin;
+    }
+    return (code_gen_wrap_end - origin) + (tc_ptr - code_gen_buffer);
+}
+
+/* Amount of generated code currently live in the buffer.  */
+static unsigned long tb_code_size(void)
+{
+    if (nb_tbs == 0) {
+        return 0;
+    }
+    return tb_code_offset(tbs[tb_first].tc_ptr, code_gen_ptr);
+}
+
+/* Return true if there is room to generate the largest possible TB at
+   code_gen_ptr, wrapping around to the start of the buffer if needed. */
+static bool tb_code_space_available(void)
+{
+    unsigned long reserve = code_gen_buffer_size - code_gen_buffer_max_size;
+    uint8_t *oldest;
+
+    if (nb_tbs == 0) {
+        code_gen_ptr = code_gen_buffer;
+        return true;
+    }
+    oldest = tbs[tb_first].tc_ptr;
+    if (code_gen_ptr > oldest) {
+        if (code_gen_ptr - code_gen_buffer < code_gen_buffer_max_size) {
+            return true;
+        }
+        code_gen_wrap_end = code_gen_ptr;
+        code_gen_ptr = code_gen_buffer;
+    }
+    return code_gen_ptr + reserve <= oldest;
+}
+
+/* Allocate a new translation block. Return NULL if too many translation
+   blocks or too much generated code; the caller then evicts old code. */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
     TranslationBlock *tb;
 
-    if (nb_tbs >= code_gen_max_blocks ||
-        (code_gen_ptr - code_gen_buffer) >= code_gen_buffer_max_size)
+    if (nb_tbs >= code_gen_max_blocks || !tb_code_space_available())
         return NULL;
-    tb = &tbs[nb_tbs++];
+    tb = tb_nth(nb_tbs++);
     tb->pc = pc;
     tb->cflags = 0;
+    tb->prof_samples = 0;
     return tb;
 }
 
@@ -696,12 +819,49 @@ void tb_free(TranslationBlock *tb)
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (nb_tbs > 0 && tb == &tbs[nb_tbs - 1]) {
+    if (nb_tbs > 0 && tb == tb_nth(nb_tbs - 1)) {
         code_gen_ptr = tb->tc_ptr;
         nb_tbs--;
     }
 }
 
+/* Invalidate the oldest code_gen_evict_size bytes of generated code.
+   tb_phys_invalidate() unlinks any chained jumps into the evicted TBs
+   and drops them from the jump caches, so the rest of the translation
+   cache stays usable. */
+static void tb_evict_region(void)
+{
+    TranslationBlock *tb;
+    uint8_t *origin;
+
+    if (nb_tbs == 0) {
+        return;
+    }
+#if defined(CONFIG_USER_ONLY)
+    tb_cache_discard();
+#endif
+    origin = tbs[tb_first].tc_ptr;
+    while (nb_tbs > 0) {
+        tb = &tbs[tb_first];
+        if (tb_code_offset(origin, tb->tc_ptr) >= code_gen_evict_size) {
+            break;
+        }
+        if (tb->page_addr[0] != -1) {
+            tb_phys_invalidate(tb, -1);
+        }
+        if (++tb_first == code_gen_max_blocks) {
+            tb_first = 0;
+        }
+        nb_tbs--;
+        tb_evict_count++;
+    }
+    if (nb_tbs == 0) {
+        tb_first = 0;
+        code_gen_ptr = code_gen_buffer;
+    }
+    tb_evict_region_count++;
+}
+
 static inline void invalidate_page_bitmap(PageDesc *p)
 {
     if (p->code_bitmap) {
@@ -725,6 +885,8 @@ static void page_flush_tb_1 (int level, void **lp)
         for (i = 0; i < L2_SIZE; ++i) {
             pd[i].first_tb = NULL;
             invalidate_page_bitmap(pd + i);
+            pd[i].smc_count = 0;
+            pd[i].smc_lines = 0;
         }
     } else {
         void **pp = *lp;
@@ -742,6 +904,139 @@ static void page_flush_tb(void)
     }
 }
 
+static inline uint32_t tb_hash_func(tb_page_addr_t phys_pc, target_ulong pc,
+                                    uint64_t flags)
+{
+    uint64_t h;
+
+    h = (uint64_t)phys_pc * 0x9e3779b97f4a7c15ULL;
+    h ^= (uint64_t)pc * 0xc2b2ae3d27d4eb4fULL;
+    h ^= flags * 0x165667b19e3779f9ULL;
+    return h >> 32;
+}
+
+/* Rehash all TBs into a table of 1 << bits slots.  */
+static void tb_hash_resize(unsigned int bits)
+{
+    TBHashSlot *old_table = tb_hash_table;
+    unsigned int i, j, old_size;
+
+    old_size = old_table ? tb_hash_mask + 1 : 0;
+    tb_hash_table = g_malloc0(sizeof(TBHashSlot) << bits);
+    tb_hash_bits = bits;
+    tb_hash_mask = (1u << bits) - 1;
+    for (i = 0; i < old_size; i++) {
+        if (old_table[i].tb) {
+            j = old_table[i].hash & tb_hash_mask;
+            while (tb_hash_table[j].tb) {
+                j = (j + 1) & tb_hash_mask;
+            }
+            tb_hash_table[j] = old_table[i];
+        }
+    }
+    g_free(old_table);
+}
+
+static void tb_hash_insert(TranslationBlock *tb, tb_page_addr_t phys_pc)
+{
+    uint32_t h = tb_hash_func(phys_pc, tb->pc, tb->flags);
+    unsigned int i;
+
+    /* keep the load factor below 1/2 so that probe sequences stay short */
+    if (2 * (tb_hash_count + 1) > tb_hash_mask + 1) {
+        tb_hash_resize(tb_hash_bits + 1);
+        tb_hash_resize_count++;
+    }
+    i = h & tb_hash_mask;
+    while (tb_hash_table[i].tb) {
+        i = (i + 1) & tb_hash_mask;
+    }
+    tb_hash_table[i].hash = h;
+    tb_hash_table[i].tb = tb;
+    tb_hash_count++;
+}
+
+static void tb_hash_remove(TranslationBlock *tb, tb_page_addr_t phys_pc)
+{
+    unsigned int i, j, home;
+
+    i = tb_hash_func(phys_pc, tb->pc, tb->flags) & tb_hash_mask;
+    while (tb_hash_table[i].tb != tb) {
+        if (!tb_hash_table[i].tb) {
+            return;
+        }
+        i = (i + 1) & tb_hash_mask;
+    }
+    /* Close the hole: move back every following entry of the probe
+       sequence whose home slot does not lie cyclically in (i, j].  */
+    for (j = (i + 1) & tb_hash_mask; tb_hash_table[j].tb;
+         j = (j + 1) & tb_hash_mask) {
+        home = tb_hash_table[j].hash & tb_hash_mask;
+        if (((j - home) & tb_hash_mask) >= ((j - i) & tb_hash_mask)) {
+            tb_hash_table[i] = tb_hash_table[j];
+            i = j;
+        }
+    }
+    tb_hash_table[i].hash = 0;
+    tb_hash_table[i].tb = NULL;
+    tb_hash_count--;
+}
+
+/* Find the TB for the given CPU state, or NULL if it must be translated. */
+TranslationBlock *tb_hash_lookup(CPUState *env, tb_page_addr_t phys_pc,
+                                 target_ulong pc, target_ulong cs_base,
+                                 uint64_t flags)
+{
+    TranslationBlock *tb;
+    tb_page_addr_t phys_page1 = phys_pc & TARGET_PAGE_MASK;
+    uint32_t h = tb_hash_func(phys_pc, pc, flags);
+    unsigned int i, probes;
+#ifdef CONFIG_PROFILER
+    int64_t ti = profile_getclock();
+#endif
+
+    for (i = h & tb_hash_mask, probes = 1; (tb = tb_hash_table[i].tb);
+         i = (i + 1) & tb_hash_mask, probes++) {
+        if (tb_hash_table[i].hash != h ||
+            tb->pc != pc ||
+            tb->page_addr[0] != phys_page1 ||
+            tb->cs_base != cs_base ||
+            tb->flags != flags) {
+            continue;
+        }
+        /* check next page if needed */
+        if (tb->page_addr[1] == -1 ||
+            tb->page_addr[1] == get_page_addr_code(env, (pc & TARGET_PAGE_MASK)
+                                                   + TARGET_PAGE_SIZE)) {
+            break;
+        }
+    }
+    tb_hash_lookup_count++;
+    tb_hash_probe_count += probes;
+    if (probes > tb_hash_max_probes) {
+        tb_hash_max_probes = probes;
+    }
+    if (!tb) {
+        tb_hash_miss_count++;
+    }
+#ifdef CONFIG_PROFILER
+    tb_hash_lookup_time += profile_getclock() - ti;
+#endif
+    return tb;
+}
+
+/* Set the number of jump cache index bits.  Only valid before the
+   first CPU is created.  */
+int tb_jmp_cache_set_bits(unsigned int bits)
+{
+    if (first_cpu || bits < TB_JMP_CACHE_BITS_MIN ||
+        bits > TB_JMP_CACHE_BITS_MAX) {
+        return -1;
+    }
+    tb_jmp_cache_bits = bits;
+    return 0;
+}
+
 /* flush all the translation blocks */
 /* XXX: tb_flush is currently not thread safe */
 void tb_flush(CPUState *env1)
@@ -757,12 +1052,19 @@ void tb_flush(CPUState *env1)
         cpu_abort(env1, "Internal error: code buffer overflow\n");
 
     nb_tbs = 0;
+    tb_first = 0;
+#if defined(CONFIG_USER_ONLY)
+    tb_cache_discard();
+#endif
 
     for(env = first_cpu; env != NULL; env = env->next_cpu) {
         memset (env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
     }
 
-    memset (tb_phys_hash, 0, CODE_GEN_PHYS_HASH_SIZE * sizeof (void *));
+    if (tb_hash_table) {
+        memset(tb_hash_table, 0, (tb_hash_mask + 1) * sizeof(TBHashSlot));
+        tb_hash_count = 0;
+    }
     page_flush_tb();
 
     code_gen_ptr = code_gen_buffer;
@@ -776,16 +1078,15 @@ void tb_flush(CPUState *env1)
 static void tb_invalidate_check(target_ulong address)
 {
     TranslationBlock *tb;
-    int i;
+    unsigned int i;
     address &= TARGET_PAGE_MASK;
-    for(i = 0;i < CODE_GEN_PHYS_HASH_SIZE; i++) {
-        for(tb = tb_phys_hash[i]; tb != NULL; tb = tb->phys_hash_next) {
-            if (!(address + TARGET_PAGE_SIZE <= tb->pc ||
-                  address >= tb->pc + tb->size)) {
-                printf("ERROR invalidate: address=" TARGET_FMT_lx
-                       " PC=%08lx size=%04x\n",
-                       address, (long)tb->pc, tb->size);
-            }
+    for (i = 0; i <= tb_hash_mask; i++) {
+        tb = tb_hash_table[i].tb;
+        if (tb && !(address + TARGET_PAGE_SIZE <= tb->pc ||
+                    address >= tb->pc + tb->size)) {
+            printf("ERROR invalidate: address=" TARGET_FMT_lx
+                   " PC=%08lx size=%04x\n",
+                   address, (long)tb->pc, tb->size);
         }
     }
 }
@@ -794,37 +1095,25 @@ static void tb_invalidate_check(target_ulong address)
 static void tb_page_check(void)
 {
     TranslationBlock *tb;
-    int i, flags1, flags2;
-
-    for(i = 0;i < CODE_GEN_PHYS_HASH_SIZE; i++) {
-        for(tb = tb_phys_hash[i]; tb != NULL; tb = tb->phys_hash_next) {
-            flags1 = page_get_flags(tb->pc);
-            flags2 = page_get_flags(tb->pc + tb->size - 1);
-            if ((flags1 & PAGE_WRITE) || (flags2 & PAGE_WRITE)) {
-                printf("ERROR page flags: PC=%08lx size=%04x f1=%x f2=%x\n",
-                       (long)tb->pc, tb->size, flags1, flags2);
-            }
+    unsigned int i;
+    int flags1, flags2;
+
+    for (i = 0; i <= tb_hash_mask; i++) {
+        tb = tb_hash_table[i].tb;
+        if (!tb) {
+            continue;
+        }
+        flags1 = page_get_flags(tb->pc);
+        flags2 = page_get_flags(tb->pc + tb->size - 1);
+        if ((flags1 & PAGE_WRITE) || (flags2 & PAGE_WRITE)) {
+            printf("ERROR page flags: PC=%08lx size=%04x f1=%x f2=%x\n",
+                   (long)tb->pc, tb->size, flags1, flags2);
         }
     }
 }
 
 #endif
 
-/* invalidate one TB */
-static inline void tb_remove(TranslationBlock **ptb, TranslationBlock *tb,
-                             int next_offset)
-{
-    TranslationBlock *tb1;
-    for(;;) {
-        tb1 = *ptb;
-        if (tb1 == tb) {
-            *ptb = *(TranslationBlock **)((char *)tb1 + next_offset);
-            break;
-        }
-        ptb = (TranslationBlock **)((char *)tb1 + next_offset);
-    }
-}
-
 static inline void tb_page_remove(TranslationBlock **ptb, TranslationBlock *tb)
 {
     TranslationBlock *tb1;
@@ -885,11 +1174,9 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     tb_page_addr_t phys_pc;
     TranslationBlock *tb1, *tb2;
 
-    /* remove the TB from the hash list */
+    /* remove the TB from the hash table */
     phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
-    h = tb_phys_hash_func(phys_pc);
-    tb_remove(&tb_phys_hash[h], tb,
-              offsetof(TranslationBlock, phys_hash_next));
+    tb_hash_remove(tb, phys_pc);
 
     /* remove the TB from the page list */
     if (tb->page_addr[0] != page_addr) {
@@ -930,6 +1217,8 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
     tb->jmp_first = (TranslationBlock *)((long)tb | 2); /* fail safe */
 
+    /* mark the TB as dead so that code eviction skips it */
+    tb->page_addr[0] = -1;
     tb_phys_invalidate_count++;
 }
 
@@ -988,6 +1277,86 @@ static void build_page_bitmap(PageDesc *p)
     }
 }
 
+/* Record a guest write at 'offset' in the page which invalidated
+   translated code. */
+static void tb_smc_record(PageDesc *p, int offset)
+{
+    smc_invalidate_count++;
+    if (++p->smc_count == SMC_DEMOTE_THRESHOLD) {
+        smc_demoted_page_count++;
+    }
+    p->smc_lines |= (uint64_t)1 << (offset >> SMC_LINE_SHIFT);
+}
+
+/* Return the compile flags of a new TB starting at 'phys_pc'. */
+static int tb_smc_cflags(tb_page_addr_t phys_pc)
+{
+    PageDesc *p;
+    int line;
+
+    p = page_find(phys_pc >> TARGET_PAGE_BITS);
+    if (!p || p->smc_count < SMC_DEMOTE_THRESHOLD) {
+        return 0;
+    }
+    line = (phys_pc & ~TARGET_PAGE_MASK) >> SMC_LINE_SHIFT;
+    if (!((p->smc_lines >> line) & 1)) {
+        return 0;
+    }
+    smc_tb_count++;
+    return CF_NOCHAIN | 1;
+}
+
+/* perf map.
+
+   With -perfmap every TB that becomes executable is described by a
+   "<host start> <host size> <name>" line in /tmp/perf-<pid>.map, the
+   format Linux perf uses for JIT code.  The name is the guest symbol
+   of the TB when the guest image provides one, followed by its guest
+   PC.  Code buffer space is reused after eviction; perf resolves the
+   addresses with the lines written last.  */
+
+int tb_perf_map_enabled;
+static FILE *tb_perf_map_file;
+
+void tb_perf_map_enable(void)
+{
+    tb_perf_map_enabled = 1;
+}
+
+void tb_perf_map_flush(void)
+{
+    if (tb_perf_map_file) {
+        fflush(tb_perf_map_file);
+    }
+}
+
+static void tb_perf_map_atexit(void)
+{
+    tb_perf_map_flush();
+}
+
+static void tb_perf_map_add(TranslationBlock *tb, int code_size)
+{
+    const char *sym;
+    char filename[64];
+
+    if (!tb_perf_map_file) {
+        /* opened lazily because daemonizing changes the pid */
+        snprintf(filename, sizeof(filename), "/tmp/perf-%d.map", getpid());
+        tb_perf_map_file = fopen(filename, "w");
+        if (!tb_perf_map_file) {
+            perror(filename);
+            tb_perf_map_enabled = 0;
+            return;
+        }
+        atexit(tb_perf_map_atexit);
+    }
+    sym = lookup_symbol(tb->pc);
+    fprintf(tb_perf_map_file, "%lx %x %s:" TARGET_FMT_lx "\n",
+            (unsigned long)tb->tc_ptr, code_size, *sym ? sym : "guest",
+            tb->pc);
+}
+
 TranslationBlock *tb_gen_code(CPUState *env,
                               target_ulong pc, target_ulong cs_base,
                               int flags, int cflags)
@@ -999,12 +1368,27 @@ TranslationBlock *tb_gen_code(CPUState *env,
     int code_gen_size;
 
     phys_pc = get_page_addr_code(env, pc);
+    if (cflags == 0) {
+        cflags = tb_smc_cflags(phys_pc);
+    }
+#if defined(CONFIG_USER_ONLY)
+    if (cflags == 0) {
+        tb = tb_cache_lookup(pc, cs_base, flags);
+        if (tb) {
+            if (unlikely(tb_perf_map_enabled) && tb->pc_map_offset) {
+                tb_perf_map_add(tb, tb->pc_map_offset);
+            }
+            return tb;
+        }
+    }
+#endif
     tb = tb_alloc(pc);
     if (!tb) {
-        /* flush must be done */
-        tb_flush(env);
-        /* cannot fail at this point */
-        tb = tb_alloc(pc);
+        /* evict the oldest code until the new TB fits */
+        do {
+            tb_evict_region();
+            tb = tb_alloc(pc);
+        } while (!tb);
         /* Don't forget to invalidate previous TB info.  */
         tb_invalidated_flag = 1;
     }
@@ -1023,6 +1407,11 @@ TranslationBlock *tb_gen_code(CPUState *env,
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
     tb_link_page(tb, phys_pc, phys_page2);
+    if (unlikely(tb_perf_map_enabled)) {
+        /* the PC mapping table follows the host code */
+        tb_perf_map_add(tb, tb->pc_map_offset ? tb->pc_map_offset
+                                              : code_gen_size);
+    }
     return tb;
 }
 
@@ -1038,7 +1427,7 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
     CPUState *env = cpu_single_env;
     tb_page_addr_t tb_start, tb_end;
     PageDesc *p;
-    int n;
+    int n, smc_recorded = 0;
 #ifdef TARGET_HAS_PRECISE_SMC
     int current_tb_not_found = is_cpu_write_access;
     TranslationBlock *current_tb = NULL;
@@ -1052,7 +1441,8 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
     if (!p)
         return;
     if (!p->code_bitmap &&
-        ++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD &&
+        (++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD ||
+         p->smc_count >= SMC_DEMOTE_THRESHOLD) &&
         is_cpu_write_access) {
         /* build code bitmap */
         build_page_bitmap(p);
@@ -1076,6 +1466,10 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
             tb_end = tb_start + ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
         }
         if (!(tb_end <= start || tb_start >= end)) {
+            if (is_cpu_write_access && !smc_recorded) {
+                tb_smc_record(p, start & ~TARGET_PAGE_MASK);
+                smc_recorded = 1;
+            }
 #ifdef TARGET_HAS_PRECISE_SMC
             if (current_tb_not_found) {
                 current_tb_not_found = 0;
@@ -1287,17 +1681,11 @@ static inline void tb_alloc_page(TranslationBlock *tb,
 void tb_link_page(TranslationBlock *tb,
                   tb_page_addr_t phys_pc, tb_page_addr_t phys_page2)
 {
-    unsigned int h;
-    TranslationBlock **ptb;
-
     /* Grab the mmap lock to stop another thread invalidating this TB
        before we are done.  */
     mmap_lock();
     /* add in the physical hash table */
-    h = tb_phys_hash_func(phys_pc);
-    ptb = &tb_phys_hash[h];
-    tb->phys_hash_next = *ptb;
-    *ptb = tb;
+    tb_hash_insert(tb, phys_pc);
 
     /* add in the page list */
     tb_alloc_page(tb, 0, phys_pc & TARGET_PAGE_MASK);
@@ -1327,30 +1715,600 @@ void tb_link_page(TranslationBlock *tb,
 TranslationBlock *tb_find_pc(unsigned long tc_ptr)
 {
     int m_min, m_max, m;
-    unsigned long v;
+    unsigned long v, off;
+    uint8_t *origin;
     TranslationBlock *tb;
 
     if (nb_tbs <= 0)
         return NULL;
     if (tc_ptr < (unsigned long)code_gen_buffer ||
-        tc_ptr >= (unsigned long)code_gen_ptr)
+        tc_ptr >= (unsigned long)code_gen_buffer + code_gen_buffer_size)
+        return NULL;
+    origin = tbs[tb_first].tc_ptr;
+    off = tb_code_offset(origin, (uint8_t *)tc_ptr);
+    if (off >= tb_code_size())
         return NULL;
     /* binary search (cf Knuth) */
     m_min = 0;
     m_max = nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tbs[m];
-        v = (unsigned long)tb->tc_ptr;
-        if (v == tc_ptr)
+        tb = tb_nth(m);
+        v = tb_code_offset(origin, tb->tc_ptr);
+        if (v == off)
             return tb;
-        else if (tc_ptr < v) {
+        else if (off < v) {
             m_max = m - 1;
         } else {
             m_min = m + 1;
         }
     }
-    return &tbs[m_max];
+    return tb_nth(m_max);
+}
+
+#if defined(CONFIG_USER_ONLY)
+/* Persistent translation cache.
+
+   At exit the whole translation state (tbs[] ring and code_gen_buffer)
+   is written to a file together with a copy of the guest code of each
+   TB.  On the next run with the same qemu binary, guest_base and key it
+   is read back to the same addresses; the TBs start out dormant and are
+   only linked in when the guest code at their pc still matches.  This
+   needs no relocation because both the code buffer and tbs[] are static
+   and the generated code only refers to them and to qemu's own text. */
+
+#define TB_CACHE_MAGIC   "QEMUTBC"
+#define TB_CACHE_VERSION 1
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tb_struct_size;
+    uint64_t exe_size;
+    uint64_t exe_mtime;
+    uint64_t exe_ino;
+    uint64_t code_gen_buffer;
+    uint64_t tbs;
+    uint64_t text;
+    uint64_t guest_base;
+    uint64_t code_gen_buffer_size;
+    uint32_t max_blocks;
+    char key[64];
+    uint32_t tb_first;
+    uint32_t nb_tbs;
+    uint64_t code_size;
+    uint64_t code_gen_ptr;
+    uint64_t wrap_end;
+    uint64_t guest_code_size;
+} TBCacheHeader;
+
+static char *tb_cache_filename;
+static char tb_cache_key[64];
+/* dormant TBs, chained through phys_hash_next */
+static TranslationBlock **tb_cache_hash;
+/* guest code of each dormant TB, indexed by tbs[] slot */
+static uint8_t *tb_cache_guest_code;
+static uint32_t *tb_cache_guest_offset;
+
+static void tb_cache_fill_header(TBCacheHeader *h)
+{
+    struct stat st;
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, TB_CACHE_MAGIC, sizeof(TB_CACHE_MAGIC));
+    h->version = TB_CACHE_VERSION;
+    h->tb_struct_size = sizeof(TranslationBlock);
+    if (stat("/proc/self/exe", &st) == 0) {
+        h->exe_size = st.st_size;
+        h->exe_mtime = st.st_mtime;
+        h->exe_ino = st.st_ino;
+    }
+    h->code_gen_buffer = (uintptr_t)code_gen_buffer;
+    h->tbs = (uintptr_t)tbs;
+    h->text = (uintptr_t)tb_gen_code;
+    h->guest_base = GUEST_BASE;
+    h->code_gen_buffer_size = code_gen_buffer_size;
+    h->max_blocks = code_gen_max_blocks;
+    pstrcpy(h->key, sizeof(h->key), tb_cache_key);
+}
+
+static void tb_cache_discard(void)
+{
+    if (!tb_cache_hash) {
+        return;
+    }
+    g_free(tb_cache_hash);
+    g_free(tb_cache_guest_code);
+    g_free(tb_cache_guest_offset);
+    tb_cache_hash = NULL;
+    tb_cache_guest_code = NULL;
+    tb_cache_guest_offset = NULL;
+}
+
+static inline bool tb_cache_is_dormant(TranslationBlock *tb)
+{
+    return tb_cache_guest_offset &&
+        tb_cache_guest_offset[tb - tbs] != UINT32_MAX;
+}
+
+static TranslationBlock *tb_cache_lookup(target_ulong pc, target_ulong cs_base,
+                                         uint64_t flags)
+{
+    TranslationBlock *tb, **ptb;
+    target_ulong virt_page2;
+    tb_page_addr_t phys_page2;
+    unsigned int h;
+
+    if (!tb_cache_hash) {
+        return NULL;
+    }
+    h = tb_phys_hash_func(pc);
+    for (ptb = &tb_cache_hash[h]; (tb = *ptb) != NULL;
+         ptb = &tb->phys_hash_next) {
+        if (tb->pc != pc || tb->cs_base != cs_base || tb->flags != flags) {
+            continue;
+        }
+        if (page_check_range(pc, tb->size, PAGE_READ) < 0 ||
+            memcmp(g2h(pc), tb_cache_guest_code +
+                   tb_cache_guest_offset[tb - tbs], tb->size) != 0) {
+            continue;
+        }
+        *ptb = tb->phys_hash_next;
+        tb_cache_guest_offset[tb - tbs] = UINT32_MAX;
+
+        virt_page2 = (pc + tb->size - 1) & TARGET_PAGE_MASK;
+        phys_page2 = -1;
+        if ((pc & TARGET_PAGE_MASK) != virt_page2) {
+            phys_page2 = virt_page2;
+        }
+        tb_link_page(tb, pc, phys_page2);
+        return tb;
+    }
+    return NULL;
+}
+
+void tb_cache_load(const char *filename, const char *key)
+{
+    TBCacheHeader h, cur;
+    TranslationBlock *tb;
+    uint32_t *len = NULL;
+    uint32_t off;
+    FILE *f;
+    int i;
+
+    tb_cache_filename = g_strdup(filename);
+    pstrcpy(tb_cache_key, sizeof(tb_cache_key), key);
+
+    f = fopen(filename, "rb");
+    if (!f) {
+        return;
+    }
+    tb_cache_fill_header(&cur);
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(&h, &cur, offsetof(TBCacheHeader, tb_first)) != 0 ||
+        h.nb_tbs > code_gen_max_blocks || h.tb_first >= code_gen_max_blocks ||
+        h.code_size > code_gen_buffer_size ||
+        h.code_gen_ptr > h.code_size || h.wrap_end > h.code_size) {
+        qemu_log("translation cache %s does not match, ignored\n", filename);
+        goto out;
+    }
+
+    tb_flush(NULL);
+    tb_cache_hash = g_malloc0(CODE_GEN_PHYS_HASH_SIZE * sizeof(*tb_cache_hash));
+    tb_cache_guest_code = g_malloc(h.guest_code_size);
+    tb_cache_guest_offset = g_malloc(code_gen_max_blocks * sizeof(uint32_t));
+    memset(tb_cache_guest_offset, 0xff, code_gen_max_blocks * sizeof(uint32_t));
+    len = g_malloc(h.nb_tbs * sizeof(uint32_t));
+
+    tb_first = h.tb_first;
+    for (i = 0; i < h.nb_tbs; i++) {
+        if (fread(tb_nth(i), sizeof(TranslationBlock), 1, f) != 1) {
+            goto fail;
+        }
+    }
+    if (fread(len, sizeof(uint32_t), h.nb_tbs, f) != h.nb_tbs ||
+        fread(tb_cache_guest_code, 1, h.guest_code_size, f) !=
+        h.guest_code_size ||
+        fread(code_gen_buffer, 1, h.code_size, f) != h.code_size) {
+        goto fail;
+    }
+
+    off = 0;
+    for (i = 0; i < h.nb_tbs; i++) {
+        tb = tb_nth(i);
+        tb->page_addr[0] = -1;
+        tb->page_addr[1] = -1;
+
+        /* The saved code still contains the direct jumps between TBs of
+           the previous run.  Unchain everything, so that a revived TB
+           always returns to the main loop and only reaches other TBs
+           through tb_add_jump() once they have been checked as well.  */
+        tb->jmp_first = (TranslationBlock *)((long)tb | 2);
+        tb->jmp_next[0] = NULL;
+        tb->jmp_next[1] = NULL;
+        if (tb->tb_next_offset[0] != 0xffff) {
+            tb_reset_jump(tb, 0);
+        }
+        if (tb->tb_next_offset[1] != 0xffff) {
+            tb_reset_jump(tb, 1);
+        }
+
+        if (len[i] == 0) {
+            continue;
+        }
+        if (len[i] != tb->size || off + len[i] > h.guest_code_size) {
+            goto fail;
+        }
+        tb_cache_guest_offset[tb - tbs] = off;
+        off += len[i];
+        tb->phys_hash_next = tb_cache_hash[tb_phys_hash_func(tb->pc)];
+        tb_cache_hash[tb_phys_hash_func(tb->pc)] = tb;
+    }
+    nb_tbs = h.nb_tbs;
+    code_gen_ptr = code_gen_buffer + h.code_gen_ptr;
+    code_gen_wrap_end = code_gen_buffer + h.wrap_end;
+    flush_icache_range((unsigned long)code_gen_buffer,
+                       (unsigned long)code_gen_buffer + h.code_size);
+    goto out;
+
+ fail:
+    qemu_log("translation cache %s is truncated, ignored\n", filename);
+    tb_cache_discard();
+    tb_first = 0;
+    code_gen_ptr = code_gen_buffer;
+ out:
+    g_free(len);
+    fclose(f);
+}
+
+void tb_cache_save(void)
+{
+    TBCacheHeader h;
+    TranslationBlock *tb;
+    uint32_t *len;
+    char *tmpname;
+    FILE *f;
+    int i;
+
+    if (!tb_cache_filename) {
+        return;
+    }
+
+    /* Other guest threads keep running until exit_group() kills them.
+       tb_lock keeps them from generating TBs while the ring and the code
+       buffer are written out, and mmap_lock keeps the guest code that is
+       copied from being unmapped or invalidated under our feet.  */
+    spin_lock(&tb_lock);
+    mmap_lock();
+
+    tb_cache_fill_header(&h);
+    h.tb_first = tb_first;
+    h.nb_tbs = nb_tbs;
+    h.code_gen_ptr = code_gen_ptr - code_gen_buffer;
+    if (nb_tbs > 0 && code_gen_ptr <= tbs[tb_first].tc_ptr) {
+        h.wrap_end = code_gen_wrap_end - code_gen_buffer;
+        h.code_size = h.wrap_end;
+    } else {
+        h.code_size = h.code_gen_ptr;
+    }
+
+    /* only TBs whose guest code can be checked on reload are kept */
+    len = g_malloc(nb_tbs * sizeof(uint32_t));
+    h.guest_code_size = 0;
+    for (i = 0; i < nb_tbs; i++) {
+        tb = tb_nth(i);
+        len[i] = 0;
+        if (tb_cache_is_dormant(tb) ||
+            (tb->page_addr[0] != -1 && tb->cflags == 0 &&
+             page_check_range(tb->pc, tb->size, PAGE_READ) == 0)) {
+            len[i] = tb->size;
+        }
+        h.guest_code_size += len[i];
+    }
+
+    tmpname = g_strdup_printf("%s.%d", tb_cache_filename, getpid());
+    f = fopen(tmpname, "wb");
+    if (!f) {
+        goto out;
+    }
+    fwrite(&h, sizeof(h), 1, f);
+    for (i = 0; i < nb_tbs; i++) {
+        fwrite(tb_nth(i), sizeof(TranslationBlock), 1, f);
+    }
+    fwrite(len, sizeof(uint32_t), nb_tbs, f);
+    for (i = 0; i < nb_tbs; i++) {
+        tb = tb_nth(i);
+        if (len[i] == 0) {
+            continue;
+        }
+        if (tb_cache_is_dormant(tb)) {
+            fwrite(tb_cache_guest_code + tb_cache_guest_offset[tb - tbs],
+                   1, len[i], f);
+        } else {
+            fwrite(g2h(tb->pc), 1, len[i], f);
+        }
+    }
+    fwrite(code_gen_buffer, 1, h.code_size, f);
+    if (ferror(f) | fclose(f)) {
+        unlink(tmpname);
+    } else {
+        rename(tmpname, tb_cache_filename);
+    }
+ out:
+    mmap_unlock();
+    spin_unlock(&tb_lock);
+    g_free(tmpname);
+    g_free(len);
+}
+#endif /* CONFIG_USER_ONLY */
+
+/* JIT profiler.
+
+   A SIGPROF timer samples the host PC; samples that fall into the code
+   buffer are charged to their TB with tb_find_pc(), so that each TB
+   accumulates an estimate of the host time spent in its code.  The
+   handler does not take any lock: a sample that races with code
+   eviction may be charged to the wrong TB, which is harmless.
+
+   With a non-zero hot threshold the profile also selects the
+   optimization level.  TBs are first translated without tcg_optimize();
+   once a TB has collected tb_profile_hot_samples samples it is
+   retranslated with CF_HOT, which turns the optimizer back on.  */
+
+#define JIT_PROFILE_DEFAULT_HZ   1000
+
+int tb_profile_hz;
+unsigned int tb_profile_hot_samples;
+static const char *tb_profile_filename;
+static uint64_t tb_profile_sample_count;
+static uint64_t tb_profile_code_sample_count;
+static int tb_profile_hot_count;
+/* process CPU time in microseconds when sampling started */
+static int64_t tb_profile_start_time;
+
+/* Parse "[file=<name>][,hz=<n>][,hot=<n>]".  Return -1 on error. */
+int tb_profile_configure(const char *opts)
+{
+    const char *p, *end, *val;
+    char *endp;
+    unsigned long n;
+    size_t len;
+
+    tb_profile_hz = JIT_PROFILE_DEFAULT_HZ;
+    for (p = opts; *p; p = *end ? end + 1 : end) {
+        end = strchr(p, ',');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        len = end - p;
+        val = memchr(p, '=', len);
+        if (!val) {
+            return -1;
+        }
+        val++;
+        if (strstart(p, "file=", NULL)) {
+            tb_profile_filename = g_strndup(val, end - val);
+            continue;
+        }
+        n = strtoul(val, &endp, 0);
+        if (endp != end || val == end) {
+            return -1;
+        }
+        if (strstart(p, "hz=", NULL) && n > 0 && n <= 100000) {
+            tb_profile_hz = n;
+        } else if (strstart(p, "hot=", NULL)) {
+            tb_profile_hot_samples = n;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#if defined(CONFIG_POSIX)
+static int64_t tb_profile_cpu_time(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000LL +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static unsigned long host_signal_pc(void *puc)
+{
+#if defined(__linux__) && defined(__x86_64__)
+    return ((ucontext_t *)puc)->uc_mcontext.gregs[REG_RIP];
+#elif defined(__linux__) && defined(__i386__)
+    return ((ucontext_t *)puc)->uc_mcontext.gregs[REG_EIP];
+#elif defined(__linux__) && defined(__arm__)
+    return ((ucontext_t *)puc)->uc_mcontext.arm_pc;
+#elif defined(__linux__) && defined(__powerpc64__)
+    return ((ucontext_t *)puc)->uc_mcontext.gp_regs[32];
+#elif defined(__linux__) && defined(_ARCH_PPC)
+    return ((ucontext_t *)puc)->uc_mcontext.uc_regs->gregs[32];
+#else
+    return 0;
+#endif
+}
+
+static void tb_profile_signal(int sig, siginfo_t *info, void *puc)
+{
+    TranslationBlock *tb;
+    CPUState *env;
+
+    tb_profile_sample_count++;
+    tb = tb_find_pc(host_signal_pc(puc));
+    if (!tb) {
+        return;
+    }
+    tb_profile_code_sample_count++;
+    if (++tb->prof_samples == tb_profile_hot_samples && tb->cflags == 0) {
+        /* Chained TBs never go back to cpu_exec(), where hot TBs are
+           retranslated.  Leave the translated code and make sure the
+           TB is looked up again. */
+        env = cpu_single_env;
+        if (env) {
+            env->tb_jmp_cache[tb_jmp_cache_hash_func(tb->pc)] = NULL;
+            cpu_exit(env);
+        }
+    }
+}
+
+static void tb_profile_atexit(void)
+{
+    tb_profile_save();
+}
+
+/* Start sampling if the profiler was configured.  This must be called
+   after the process has daemonized, because timers are not inherited
+   by fork(). */
+void tb_profile_start(void)
+{
+    struct sigaction act;
+    struct itimerval itv;
+
+    if (!tb_profile_hz) {
+        return;
+    }
+    memset(&act, 0, sizeof(act));
+    sigfillset(&act.sa_mask);
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    act.sa_sigaction = tb_profile_signal;
+    sigaction(SIGPROF, &act, NULL);
+
+    itv.it_interval.tv_sec = 0;
+    itv.it_interval.tv_usec = 1000000 / tb_profile_hz;
+    itv.it_value = itv.it_interval;
+    if (setitimer(ITIMER_PROF, &itv, NULL) < 0) {
+        perror("setitimer");
+        tb_profile_hz = 0;
+        return;
+    }
+    tb_profile_start_time = tb_profile_cpu_time();
+    if (tb_profile_filename) {
+        atexit(tb_profile_atexit);
+    }
+}
+#else
+static int64_t tb_profile_cpu_time(void)
+{
+    return 0;
+}
+
+void tb_profile_start(void)
+{
+    if (tb_profile_hz) {
+        fprintf(stderr, "qemu: the JIT profiler is not supported on this "
+                "host\n");
+        tb_profile_hz = 0;
+    }
+}
+#endif
+
+/* Retranslate the hot TB 'tb' with CF_HOT and return the new TB.  It
+   inherits the samples of the old one, which is invalidated.  */
+TranslationBlock *tb_gen_hot_code(CPUState *env, TranslationBlock *tb)
+{
+    TranslationBlock *hot_tb;
+    target_ulong pc = tb->pc, cs_base = tb->cs_base;
+    uint64_t flags = tb->flags;
+    uint32_t samples = tb->prof_samples;
+
+    tb_phys_invalidate(tb, -1);
+    tb->prof_samples = 0;
+    hot_tb = tb_gen_code(env, pc, cs_base, flags, CF_HOT);
+    hot_tb->prof_samples = samples;
+    env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)] = hot_tb;
+    tb_profile_hot_count++;
+    return hot_tb;
+}
+
+static int tb_profile_cmp(const void *a, const void *b)
+{
+    const TranslationBlock *tb1 = *(TranslationBlock * const *)a;
+    const TranslationBlock *tb2 = *(TranslationBlock * const *)b;
+
+    if (tb1->prof_samples != tb2->prof_samples) {
+        return tb1->prof_samples < tb2->prof_samples ? 1 : -1;
+    }
+    return tb1->pc < tb2->pc ? -1 : tb1->pc > tb2->pc;
+}
+
+/* Print the TBs with the most samples, at most 'max' of them (all if
+   'max' is negative). */
+void dump_jit_profile(FILE *f, fprintf_function cpu_fprintf, int max)
+{
+    TranslationBlock *tb, **sorted;
+    double ms_per_sample;
+    int i, n;
+
+    if (!tb_profile_hz) {
+        cpu_fprintf(f, "JIT profiler not running (use -jit-profile)\n");
+        return;
+    }
+    sorted = g_new(TranslationBlock *, nb_tbs ? nb_tbs : 1);
+    n = 0;
+    for (i = 0; i < nb_tbs; i++) {
+        tb = tb_nth(i);
+        if (tb->prof_samples && tb->page_addr[0] != -1) {
+            sorted[n++] = tb;
+        }
+    }
+    qsort(sorted, n, sizeof(*sorted), tb_profile_cmp);
+
+    /* the timer granularity is often coarser than requested, so derive
+       the time per sample from the CPU time actually used */
+    ms_per_sample = 0;
+    if (tb_profile_sample_count) {
+        ms_per_sample = (tb_profile_cpu_time() - tb_profile_start_time) /
+                        1000.0 / tb_profile_sample_count;
+    }
+    cpu_fprintf(f, "samples             %" PRIu64 " (%0.2f ms each), "
+                "%" PRIu64 " (%d%%) in translated code\n",
+                tb_profile_sample_count, ms_per_sample,
+                tb_profile_code_sample_count,
+                tb_profile_sample_count ?
+                (int)(tb_profile_code_sample_count * 100 /
+                      tb_profile_sample_count) : 0);
+    if (tb_profile_hot_samples) {
+        cpu_fprintf(f, "hot retranslations  %d (threshold %u samples)\n",
+                    tb_profile_hot_count, tb_profile_hot_samples);
+    }
+    cpu_fprintf(f, "%-*s %8s %6s %9s %5s %-*s\n",
+                TARGET_LONG_BITS / 4, "pc", "samples", "%", "time ms",
+                "size", (int)sizeof(void *) * 2 + 2, "host code");
+    if (max >= 0 && n > max) {
+        n = max;
+    }
+    for (i = 0; i < n; i++) {
+        tb = sorted[i];
+        cpu_fprintf(f, TARGET_FMT_lx " %8u %5d%% %9.1f %5d %p%s\n",
+                    tb->pc, tb->prof_samples,
+                    (int)((uint64_t)tb->prof_samples * 100 /
+                          tb_profile_sample_count),
+                    tb->prof_samples * ms_per_sample,
+                    tb->size, tb->tc_ptr,
+                    tb->cflags & CF_HOT ? " hot" : "");
+    }
+    g_free(sorted);
+}
+
+/* Write the whole profile to the file given with -jit-profile file=... */
+void tb_profile_save(void)
+{
+    FILE *f;
+
+    if (!tb_profile_hz || !tb_profile_filename) {
+        return;
+    }
+    f = fopen(tb_profile_filename, "w");
+    if (!f) {
+        perror(tb_profile_filename);
+        return;
+    }
+    dump_jit_profile(f, fprintf, -1);
+    fclose(f);
 }
 
 static void tb_reset_jump_recursive(TranslationBlock *tb);
@@ -1823,6 +2781,7 @@ CPUState *cpu_copy(CPUState *env)
     CPUState *new_env = cpu_init(env->cpu_model_str);
     CPUState *next_cpu = new_env->next_cpu;
     int cpu_index = new_env->cpu_index;
+    TranslationBlock **tb_jmp_cache = new_env->tb_jmp_cache;
 #if defined(TARGET_HAS_ICE)
     CPUBreakpoint *bp;
     CPUWatchpoint *wp;
@@ -1830,9 +2789,10 @@ CPUState *cpu_copy(CPUState *env)
 
     memcpy(new_env, env, sizeof(CPUState));
 
-    /* Preserve chaining and index. */
+    /* Preserve chaining, index and jump cache. */
     new_env->next_cpu = next_cpu;
     new_env->cpu_index = cpu_index;
+    new_env->tb_jmp_cache = tb_jmp_cache;
 
     /* Clone all break/watchpoints.
        Note: Once we support ptrace with hw-debug register access, make sure
@@ -1905,6 +2865,13 @@ void tlb_flush(CPUState *env, int flush_global)
             env->tlb_table[mmu_idx][i] = s_cputlb_empty_entry;
         }
     }
+    for (i = 0; i < NB_MMU_MODES; i++) {
+        int j;
+        for (j = 0; j < CPU_VTLB_MAX_SIZE; j++) {
+            env->tlb_v_table[i][j] = s_cputlb_empty_entry;
+        }
+        env->vtlb_next[i] = 0;
+    }
 
     memset (env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
 
@@ -1925,6 +2892,119 @@ static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
     }
 }
 
+static inline bool tlb_entry_is_empty(const CPUTLBEntry *tlb_entry)
+{
+    return tlb_entry->addr_read == (target_ulong)-1 &&
+           tlb_entry->addr_write == (target_ulong)-1 &&
+           tlb_entry->addr_code == (target_ulong)-1;
+}
+
+static inline unsigned int tlb_victim_size(CPUState *env, int mmu_idx)
+{
+    return CPU_VTLB_MIN_SIZE << env->vtlb_shift[mmu_idx];
+}
+
+/* Make room in tlb_table[mmu_idx][index] for the page 'vaddr'.  The
+   entry being replaced moves to the victim TLB, and any victim copy of
+   'vaddr' is dropped so that a page is never cached twice.  */
+static void tlb_victim_evict(CPUState *env, int mmu_idx, unsigned int index,
+                             target_ulong vaddr)
+{
+    CPUTLBEntry *te = &env->tlb_table[mmu_idx][index];
+    unsigned int i, size = tlb_victim_size(env, mmu_idx);
+
+    for (i = 0; i < size; i++) {
+        tlb_flush_entry(&env->tlb_v_table[mmu_idx][i], vaddr);
+    }
+    tlb_flush_entry(te, vaddr);
+    if (tlb_entry_is_empty(te)) {
+        return;
+    }
+    i = env->vtlb_next[mmu_idx];
+    env->tlb_v_table[mmu_idx][i] = *te;
+    env->iotlb_v[mmu_idx][i] = env->iotlb[mmu_idx][index];
+    env->vtlb_next[mmu_idx] = (i + 1) & (size - 1);
+}
+
+/* Called at the end of each resize window.  Grow the victim TLB while
+   it catches a fair share of the misses but most of them still end up
+   in tlb_fill; shrink it when it hardly ever hits, since every miss
+   pays for a linear search of it.  */
+static void tlb_victim_resize(CPUState *env, int mmu_idx)
+{
+    unsigned int hits = env->vtlb_hits[mmu_idx];
+    unsigned int shift = env->vtlb_shift[mmu_idx];
+    unsigned int i, size;
+
+    env->vtlb_misses[mmu_idx] = 0;
+    env->vtlb_hits[mmu_idx] = 0;
+    if (hits >= CPU_VTLB_RESIZE_WINDOW / 16 &&
+        hits < CPU_VTLB_RESIZE_WINDOW / 2 &&
+        shift < CPU_VTLB_MAX_BITS - CPU_VTLB_MIN_BITS) {
+        shift++;
+    } else if (hits < CPU_VTLB_RESIZE_WINDOW / 16 && shift > 0) {
+        shift--;
+        size = CPU_VTLB_MIN_SIZE << shift;
+        for (i = size; i < size * 2; i++) {
+            env->tlb_v_table[mmu_idx][i] = s_cputlb_empty_entry;
+        }
+        if (env->vtlb_next[mmu_idx] >= size) {
+            env->vtlb_next[mmu_idx] = 0;
+        }
+    } else {
+        return;
+    }
+    env->vtlb_shift[mmu_idx] = shift;
+    tlb_victim_resize_count++;
+}
+
+/* Called by the softmmu helpers when 'addr' misses in
+   tlb_table[mmu_idx][index].  If the page is in the victim TLB, swap it
+   back into tlb_table and return true; otherwise the caller must call
+   tlb_fill.  */
+bool tlb_victim_hit(CPUState *env, target_ulong addr, int mmu_idx,
+                    int index, int access_type)
+{
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    unsigned int i, size = tlb_victim_size(env, mmu_idx);
+    bool hit = false;
+
+    for (i = 0; i < size; i++) {
+        CPUTLBEntry *vte = &env->tlb_v_table[mmu_idx][i];
+        target_ulong cmp;
+
+        if (access_type == 1) {
+            cmp = vte->addr_write;
+        } else if (access_type == 2) {
+            cmp = vte->addr_code;
+        } else {
+            cmp = vte->addr_read;
+        }
+        if (page == (cmp & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
+            CPUTLBEntry tmp = env->tlb_table[mmu_idx][index];
+            target_phys_addr_t iotmp = env->iotlb[mmu_idx][index];
+
+            env->tlb_table[mmu_idx][index] = *vte;
+            env->iotlb[mmu_idx][index] = env->iotlb_v[mmu_idx][i];
+            *vte = tmp;
+            env->iotlb_v[mmu_idx][i] = iotmp;
+            hit = true;
+            break;
+        }
+    }
+
+    if (hit) {
+        tlb_victim_hit_count++;
+        env->vtlb_hits[mmu_idx]++;
+    } else {
+        tlb_miss_count++;
+    }
+    if (++env->vtlb_misses[mmu_idx] >= CPU_VTLB_RESIZE_WINDOW) {
+        tlb_victim_resize(env, mmu_idx);
+    }
+    return hit;
+}
+
 void tlb_flush_page(CPUState *env, target_ulong addr)
 {
     int i;
@@ -1951,6 +3031,11 @@ void tlb_flush_page(CPUState *env, target_ulong addr)
     i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++)
         tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        for (i = 0; i < CPU_VTLB_MAX_SIZE; i++) {
+            tlb_flush_entry(&env->tlb_v_table[mmu_idx][i], addr);
+        }
+    }
 
     tlb_flush_jmp_cache(env, addr);
 }
@@ -2016,6 +3101,10 @@ void cpu_physical_memory_reset_dirty(ram_addr_t start, ram_addr_t end,
             for(i = 0; i < CPU_TLB_SIZE; i++)
                 tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                       start1, length);
+            for (i = 0; i < CPU_VTLB_MAX_SIZE; i++) {
+                tlb_reset_dirty_range(&env->tlb_v_table[mmu_idx][i],
+                                      start1, length);
+            }
         }
     }
 }
@@ -2050,6 +3139,9 @@ void cpu_tlb_update_dirty(CPUState *env)
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         for(i = 0; i < CPU_TLB_SIZE; i++)
             tlb_update_dirty(&env->tlb_table[mmu_idx][i]);
+        for (i = 0; i < CPU_VTLB_MAX_SIZE; i++) {
+            tlb_update_dirty(&env->tlb_v_table[mmu_idx][i]);
+        }
     }
 }
 
@@ -2070,6 +3162,11 @@ static inline void tlb_set_dirty(CPUState *env, target_ulong vaddr)
     i = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++)
         tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        for (i = 0; i < CPU_VTLB_MAX_SIZE; i++) {
+            tlb_set_dirty1(&env->tlb_v_table[mmu_idx][i], vaddr);
+        }
+    }
 }
 
 /* Our TLB does not support large pages, so remember the area covered by
@@ -2183,6 +3280,7 @@ void tlb_set_page(CPUState *env, target_ulong vaddr,
     }
 
     index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    tlb_victim_evict(env, mmu_idx, index, vaddr);
     env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te = &env->tlb_table[mmu_idx][index];
     te->addend = addend - vaddr;
@@ -2365,19 +3463,31 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
         flags |= PAGE_WRITE_ORG;
     }
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
+    /* Walk one leaf table at a time.  Clearing the flags of pages that
+       were never mapped does not need to allocate the tables.  */
+    for (addr = start, len = end - start; len != 0; ) {
+        target_ulong index = addr >> TARGET_PAGE_BITS;
+        target_ulong n = L2_SIZE - (index & (L2_SIZE - 1));
+        PageDesc *p = page_find_alloc(index, flags != 0);
 
-        /* If the write protection bit is set, then we invalidate
-           the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0, NULL);
+        if (n > len >> TARGET_PAGE_BITS) {
+            n = len >> TARGET_PAGE_BITS;
+        }
+        len -= n << TARGET_PAGE_BITS;
+        if (!p) {
+            addr += n << TARGET_PAGE_BITS;
+            continue;
+        }
+        for (; n != 0; n--, p++, addr += TARGET_PAGE_SIZE) {
+            /* If the write protection bit is set, then we invalidate
+               the code inside.  */
+            if (!(p->flags & PAGE_WRITE) &&
+                (flags & PAGE_WRITE) &&
+                p->first_tb) {
+                tb_invalidate_phys_page(addr, 0, NULL);
+            }
+            p->flags = flags;
         }
-        p->flags = flags;
     }
 }
 
@@ -4324,19 +5434,25 @@ void cpu_io_recompile(CPUState *env, void *retaddr)
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
     int i, target_code_size, max_target_code_size;
+    long pc_map_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    uint64_t chain_sum;
+    unsigned int slot, chain, max_chain;
     TranslationBlock *tb;
+    CPUState *env;
 
     target_code_size = 0;
     max_target_code_size = 0;
+    pc_map_size = 0;
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
     for(i = 0; i < nb_tbs; i++) {
-        tb = &tbs[i];
+        tb = tb_nth(i);
         target_code_size += tb->size;
         if (tb->size > max_target_code_size)
             max_target_code_size = tb->size;
+        pc_map_size += tb_pc_map_size(tb);
         if (tb->page_addr[1] != -1)
             cross_page++;
         if (tb->tb_next_offset[0] != 0xffff) {
@@ -4346,18 +5462,33 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
             }
         }
     }
+    /* number of probes needed to find each TB in the hash table */
+    chain_sum = 0;
+    max_chain = 0;
+    for (slot = 0; tb_hash_table && slot <= tb_hash_mask; slot++) {
+        if (tb_hash_table[slot].tb) {
+            chain = ((slot - tb_hash_table[slot].hash) & tb_hash_mask) + 1;
+            chain_sum += chain;
+            if (chain > max_chain) {
+                max_chain = chain;
+            }
+        }
+    }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
-    cpu_fprintf(f, "gen code size       %td/%ld\n",
-                code_gen_ptr - code_gen_buffer, code_gen_buffer_max_size);
+    cpu_fprintf(f, "gen code size       %ld/%ld\n",
+                tb_code_size(), code_gen_buffer_max_size);
     cpu_fprintf(f, "TB count            %d/%d\n", 
                 nb_tbs, code_gen_max_blocks);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
                 nb_tbs ? target_code_size / nb_tbs : 0,
                 max_target_code_size);
-    cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-                nb_tbs ? (code_gen_ptr - code_gen_buffer) / nb_tbs : 0,
-                target_code_size ? (double) (code_gen_ptr - code_gen_buffer) / target_code_size : 0);
+    cpu_fprintf(f, "TB avg host size    %ld bytes (expansion ratio: %0.1f)\n",
+                nb_tbs ? tb_code_size() / nb_tbs : 0,
+                target_code_size ? (double) tb_code_size() / target_code_size : 0);
+    cpu_fprintf(f, "TB avg PC map size  %ld bytes (%ld%% of host size)\n",
+                nb_tbs ? pc_map_size / nb_tbs : 0,
+                tb_code_size() ? pc_map_size * 100 / tb_code_size() : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n",
             cross_page,
             nb_tbs ? (cross_page * 100) / nb_tbs : 0);
@@ -4369,7 +5500,50 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %d\n", tb_flush_count);
     cpu_fprintf(f, "TB invalidate count %d\n", tb_phys_invalidate_count);
+    cpu_fprintf(f, "TB evict count      %d (%d regions)\n",
+                tb_evict_count, tb_evict_region_count);
+    cpu_fprintf(f, "SMC invalidations   %d (%d pages demoted, %d SMC TBs)\n",
+                smc_invalidate_count, smc_demoted_page_count, smc_tb_count);
+    cpu_fprintf(f, "TB hash table       %u/%u slots (%d resizes), "
+                "chain avg %0.2f max %u\n",
+                tb_hash_count, tb_hash_table ? tb_hash_mask + 1 : 0,
+                tb_hash_resize_count,
+                tb_hash_count ? (double)chain_sum / tb_hash_count : 0,
+                max_chain);
+    cpu_fprintf(f, "TB hash lookups     %" PRIu64 " (%" PRIu64 " misses), "
+                "probes avg %0.2f max %u\n",
+                tb_hash_lookup_count, tb_hash_miss_count,
+                tb_hash_lookup_count ?
+                (double)tb_hash_probe_count / tb_hash_lookup_count : 0,
+                tb_hash_max_probes);
+#ifdef CONFIG_PROFILER
+    cpu_fprintf(f, "TB hash lookup time %0.1f cycles avg\n",
+                tb_hash_lookup_count ?
+                (double)tb_hash_lookup_time / tb_hash_lookup_count : 0);
+#endif
+#ifdef CONFIG_PROFILER
+    cpu_fprintf(f, "TB jmp cache        %d entries per CPU, "
+                "%" PRIu64 " lookups (%" PRIu64 " misses)\n",
+                TB_JMP_CACHE_SIZE, tb_jmp_cache_lookup_count,
+                tb_jmp_cache_miss_count);
+#else
+    cpu_fprintf(f, "TB jmp cache        %d entries per CPU\n",
+                TB_JMP_CACHE_SIZE);
+#endif
+    cpu_fprintf(f, "Indirect branches   %" PRIu64 " (%" PRIu64
+                " returned to the main loop)\n",
+                tb_lookup_ptr_count, tb_lookup_ptr_miss_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    cpu_fprintf(f, "TLB miss count      %d (victim hits %d)\n",
+                tlb_miss_count, tlb_victim_hit_count);
+    cpu_fprintf(f, "TLB victim resizes  %d\n", tlb_victim_resize_count);
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        cpu_fprintf(f, "  cpu %d victim TLB entries:", env->cpu_index);
+        for (i = 0; i < NB_MMU_MODES; i++) {
+            cpu_fprintf(f, " %d", tlb_victim_size(env, i));
+        }
+        cpu_fprintf(f, "\n");
+    }
     tcg_dump_info(f, cpu_fprintf);
 }
 
@@ -40,6 +40,9 @@ these four paragraphs for those parts of this code that are retained.
  */
 #include "config.h"
 
+#include <math.h>
+#include <float.h>
+
 #include "softfloat.h"
 
 /*----------------------------------------------------------------------------
@@ -1843,6 +1846,149 @@ static float32 subFloat32Sigs( float32 a, float32 b, flag zSign STATUS_PARAM)
 
 }
 
+/*----------------------------------------------------------------------------
+| Host FPU fast path.  With round-to-nearest-even and the inexact flag
+| already raised, an add, sub, mul, div or sqrt of zero or normal operands
+| whose result is normal and finite cannot raise a flag that is not set
+| yet, and the host IEEE arithmetic returns the same bits as softfloat.
+| Such operations are done with host instructions; everything else (NaNs,
+| infinities, denormals, possible overflow or underflow, other rounding
+| modes, flags being tracked from zero) takes the softfloat path below.
+| Only hosts that evaluate float and double in their own precision qualify.
+*----------------------------------------------------------------------------*/
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define USE_HOST_FPU
+#endif
+
+flag float_use_host_fpu = 1;
+
+#ifdef USE_HOST_FPU
+enum {
+    host_fpu_add,
+    host_fpu_sub,
+    host_fpu_mul,
+    host_fpu_div,
+    host_fpu_sqrt
+};
+
+INLINE flag host_fpu_usable(float_status *status)
+{
+    return float_use_host_fpu
+        && STATUS(float_rounding_mode) == float_round_nearest_even
+        && (STATUS(float_exception_flags) & float_flag_inexact);
+}
+
+INLINE flag float32_is_zero_or_normal(float32 a)
+{
+    int16 aExp = extractFloat32Exp(a);
+    return aExp != 0xFF && (aExp != 0 || extractFloat32Frac(a) == 0);
+}
+
+INLINE flag float64_is_zero_or_normal(float64 a)
+{
+    int16 aExp = extractFloat64Exp(a);
+    return aExp != 0x7FF && (aExp != 0 || extractFloat64Frac(a) == 0);
+}
+
+INLINE flag float32_host_fpu(int op, float32 a, float32 b, float32 *r
+                             STATUS_PARAM)
+{
+    union {
+        uint32_t i;
+        float f;
+    } ua, ub, ur;
+
+    if (!host_fpu_usable(status) ||
+        !float32_is_zero_or_normal(a) || !float32_is_zero_or_normal(b)) {
+        return 0;
+    }
+    ua.i = float32_val(a);
+    ub.i = float32_val(b);
+    switch (op) {
+    case host_fpu_add:
+        ur.f = ua.f + ub.f;
+        break;
+    case host_fpu_sub:
+        ur.f = ua.f - ub.f;
+        break;
+    case host_fpu_mul:
+        ur.f = ua.f * ub.f;
+        break;
+    case host_fpu_div:
+        if (float32_is_zero(b)) {
+            return 0;
+        }
+        ur.f = ua.f / ub.f;
+        break;
+    default:
+        if (extractFloat32Sign(a)) {
+            return 0;
+        }
+        ur.f = sqrtf(ua.f);
+        break;
+    }
+    /* zero results are left to softfloat too: they may have underflowed */
+    if (!(fabsf(ur.f) > FLT_MIN) || isinf(ur.f)) {
+        return 0;
+    }
+    *r = make_float32(ur.i);
+    return 1;
+}
+
+INLINE flag float64_host_fpu(int op, float64 a, float64 b, float64 *r
+                             STATUS_PARAM)
+{
+    union {
+        uint64_t i;
+        double f;
+    } ua, ub, ur;
+
+    if (!host_fpu_usable(status) ||
+        !float64_is_zero_or_normal(a) || !float64_is_zero_or_normal(b)) {
+        return 0;
+    }
+    ua.i = float64_val(a);
+    ub.i = float64_val(b);
+    switch (op) {
+    case host_fpu_add:
+        ur.f = ua.f + ub.f;
+        break;
+    case host_fpu_sub:
+        ur.f = ua.f - ub.f;
+        break;
+    case host_fpu_mul:
+        ur.f = ua.f * ub.f;
+        break;
+    case host_fpu_div:
+        if (float64_is_zero(b)) {
+            return 0;
+        }
+        ur.f = ua.f / ub.f;
+        break;
+    default:
+        if (extractFloat64Sign(a)) {
+            return 0;
+        }
+        ur.f = sqrt(ua.f);
+        break;
+    }
+    if (!(fabs(ur.f) > DBL_MIN) || isinf(ur.f)) {
+        return 0;
+    }
+    *r = make_float64(ur.i);
+    return 1;
+}
+
+#define HOST_FPU_OP(type, op, a, b) do {                        \
+        type host_r;                                            \
+        if (type ## _host_fpu(op, a, b, &host_r STATUS_VAR)) {  \
+            return host_r;                                      \
+        }                                                       \
+    } while (0)
+#else
+#define HOST_FPU_OP(type, op, a, b) do { } while (0)
+#endif
+
 /*----------------------------------------------------------------------------
 | Returns the result of adding the single-precision floating-point values `a'
 | and `b'.  The operation is performed according to the IEC/IEEE Standard for
@@ -1852,6 +1998,7 @@ static float32 subFloat32Sigs( float32 a, float32 b, flag zSign STATUS_PARAM)
 float32 float32_add( float32 a, float32 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    HOST_FPU_OP(float32, host_fpu_add, a, b);
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1875,6 +2022,7 @@ float32 float32_add( float32 a, float32 b STATUS_PARAM )
 float32 float32_sub( float32 a, float32 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    HOST_FPU_OP(float32, host_fpu_sub, a, b);
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1903,6 +2051,7 @@ float32 float32_mul( float32 a, float32 b STATUS_PARAM )
     uint64_t zSig64;
     uint32_t zSig;
 
+    HOST_FPU_OP(float32, host_fpu_mul, a, b);
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1963,6 +2112,7 @@ float32 float32_div( float32 a, float32 b STATUS_PARAM )
     flag aSign, bSign, zSign;
     int16 aExp, bExp, zExp;
     uint32_t aSig, bSig, zSig;
+    HOST_FPU_OP(float32, host_fpu_div, a, b);
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -2336,6 +2486,7 @@ float32 float32_sqrt( float32 a STATUS_PARAM )
     int16 aExp, zExp;
     uint32_t aSig, zSig;
     uint64_t rem, term;
+    HOST_FPU_OP(float32, host_fpu_sqrt, a, float32_zero);
     a = float32_squash_input_denormal(a STATUS_VAR);
 
     aSig = extractFloat32Frac( a );
@@ -3415,6 +3566,7 @@ static float64 subFloat64Sigs( float64 a, float64 b, flag zSign STATUS_PARAM )
 float64 float64_add( float64 a, float64 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    HOST_FPU_OP(float64, host_fpu_add, a, b);
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3438,6 +3590,7 @@ float64 float64_add( float64 a, float64 b STATUS_PARAM )
 float64 float64_sub( float64 a, float64 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    HOST_FPU_OP(float64, host_fpu_sub, a, b);
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3464,6 +3617,7 @@ float64 float64_mul( float64 a, float64 b STATUS_PARAM )
     int16 aExp, bExp, zExp;
     uint64_t aSig, bSig, zSig0, zSig1;
 
+    HOST_FPU_OP(float64, host_fpu_mul, a, b);
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3526,6 +3680,7 @@ float64 float64_div( float64 a, float64 b STATUS_PARAM )
     uint64_t aSig, bSig, zSig;
     uint64_t rem0, rem1;
     uint64_t term0, term1;
+    HOST_FPU_OP(float64, host_fpu_div, a, b);
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3903,6 +4058,7 @@ float64 float64_sqrt( float64 a STATUS_PARAM )
     int16 aExp, zExp;
     uint64_t aSig, zSig, doubleZSig;
     uint64_t rem0, rem1, term0, term1;
+    HOST_FPU_OP(float64, host_fpu_sqrt, a, float64_zero);
     a = float64_squash_input_denormal(a STATUS_VAR);
 
     aSig = extractFloat64Frac( a );
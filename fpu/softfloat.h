@@ -205,6 +205,13 @@ INLINE int get_float_exception_flags(float_status *status)
 }
 void set_floatx80_rounding_precision(int val STATUS_PARAM);
 
+/*----------------------------------------------------------------------------
+| Whether float32 and float64 add, sub, mul, div and sqrt may be computed
+| with the host FPU when that is known to give the softfloat result and
+| flags.  Set by default; clearing it forces the pure softfloat path.
+*----------------------------------------------------------------------------*/
+extern flag float_use_host_fpu;
+
 /*----------------------------------------------------------------------------
 | Routine to raise any or all of the software IEC/IEEE floating-point
 | exception flags.
@@ -1346,6 +1346,8 @@ show virtual to physical memory mappings (i386, SH4, SPARC, and PPC only)
 show the active virtual memory mappings (i386 only)
 @item info jit
 show dynamic compiler info
+@item info jit-profile
+show the translated blocks where most time is spent (needs -jit-profile)
 @item info numa
 show NUMA information
 @item info kvm
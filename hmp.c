@@ -249,6 +249,7 @@ void hmp_info_block(Monitor *mon)
 void hmp_info_blockstats(Monitor *mon)
 {
     BlockStatsList *stats_list, *stats;
+    BlockCacheStatsList *cache;
 
     stats_list = qmp_query_blockstats(NULL);
 
@@ -275,6 +276,20 @@ void hmp_info_blockstats(Monitor *mon)
                        stats->value->stats->wr_total_time_ns,
                        stats->value->stats->rd_total_time_ns,
                        stats->value->stats->flush_total_time_ns);
+
+        for (cache = stats->value->stats->metadata_caches; cache;
+             cache = cache->next) {
+            monitor_printf(mon, "    %s cache: size=%" PRId64
+                           " hits=%" PRId64
+                           " misses=%" PRId64
+                           " writebacks=%" PRId64
+                           "\n",
+                           cache->value->name,
+                           cache->value->size,
+                           cache->value->hits,
+                           cache->value->misses,
+                           cache->value->writebacks);
+        }
     }
 
     qapi_free_BlockStatsList(stats_list);
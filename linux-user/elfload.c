@@ -1639,7 +1639,7 @@ static void load_elf_image(const char *image_name, int image_fd,
         info->brk = info->end_code;
     }
 
-    if (qemu_log_enabled()) {
+    if (qemu_log_enabled() || tb_perf_map_enabled) {
         load_symbols(ehdr, image_fd, load_bias);
     }
 
@@ -54,6 +54,7 @@ unsigned long reserved_va;
 static void usage(void);
 
 static const char *interp_prefix = CONFIG_QEMU_INTERP_PREFIX;
+static const char *tcache_filename;
 const char *qemu_uname_release = CONFIG_UNAME_RELEASE;
 
 /* XXX: on x86 MAP_GROWSDOWN only works if ESP <= address + 32, so
@@ -3077,6 +3078,18 @@ static void handle_arg_reserved_va(const char *arg)
 }
 #endif
 
+static void handle_arg_jit_profile(const char *arg)
+{
+    if (tb_profile_configure(arg) < 0) {
+        usage();
+    }
+}
+
+static void handle_arg_perfmap(const char *arg)
+{
+    tb_perf_map_enable();
+}
+
 static void handle_arg_singlestep(const char *arg)
 {
     singlestep = 1;
@@ -3087,6 +3100,18 @@ static void handle_arg_strace(const char *arg)
     do_strace = 1;
 }
 
+static void handle_arg_tcache(const char *arg)
+{
+    tcache_filename = arg;
+}
+
+static void handle_arg_tb_jmp_cache_bits(const char *arg)
+{
+    if (tb_jmp_cache_set_bits(strtoul(arg, NULL, 0)) < 0) {
+        usage();
+    }
+}
+
 static void handle_arg_version(const char *arg)
 {
     printf("qemu-" TARGET_ARCH " version " QEMU_VERSION QEMU_PKGVERSION
@@ -3134,10 +3159,19 @@ struct qemu_argument arg_table[] = {
      "logfile",     "override default logfile location"},
     {"p",          "QEMU_PAGESIZE",    true,  handle_arg_pagesize,
      "pagesize",   "set the host page size to 'pagesize'"},
+    {"jit-profile", "QEMU_JIT_PROFILE", true, handle_arg_jit_profile,
+     "options",    "profile translated code (file=f,hz=n,hot=n)"},
+    {"perfmap",    "QEMU_PERFMAP",     false, handle_arg_perfmap,
+     "",           "describe translated code in /tmp/perf-<pid>.map"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
+    {"tb-jmp-cache-bits", "QEMU_TB_JMP_CACHE_BITS",
+                   true,  handle_arg_tb_jmp_cache_bits,
+     "n",          "use 2^n jump cache entries per CPU (8..20, default 12)"},
+    {"tcache",     "QEMU_TCACHE",      true,  handle_arg_tcache,
+     "file",       "keep translated code in 'file' across runs"},
     {"version",    "QEMU_VERSION",     false, handle_arg_version,
      "",           "display version information and exit"},
     {NULL, NULL, false, NULL, NULL, NULL}
@@ -3525,6 +3559,10 @@ int main(int argc, char **argv, char **envp)
     tcg_prologue_init(&tcg_ctx);
 #endif
 
+    if (tcache_filename) {
+        tb_cache_load(tcache_filename, cpu_model);
+    }
+
 #if defined(TARGET_I386)
     cpu_x86_set_cpl(env, 3);
 
@@ -3821,6 +3859,7 @@ int main(int argc, char **argv, char **envp)
         }
         gdb_handlesig(env, 0);
     }
+    tb_profile_start();
     cpu_loop(env);
     /* never exits */
     return 0;
@@ -213,6 +213,9 @@ static int mmap_frag(abi_ulong real_start,
 # define TASK_UNMAPPED_BASE  0x40000000
 #endif
 static abi_ulong mmap_next_start = TASK_UNMAPPED_BASE;
+/* Number of mmap_nofixed() calls between claiming an address and
+   setting the page flags.  */
+static int mmap_nofixed_pending;
 
 unsigned long last_brk;
 
@@ -364,6 +367,80 @@ abi_ulong mmap_find_vma(abi_ulong start, abi_ulong size)
     }
 }
 
+/* Map a non-fixed region without holding mmap_lock across the host
+   mmap() call.  When host and target pages have the same size, the
+   host kernel serializes concurrent mappings itself, so the lock is
+   only taken to claim a hint address and to set the page flags.
+   Return 0 on success, -1 on error (errno set), or 1 if the caller has
+   to use the generic code.  */
+static int mmap_nofixed(abi_ulong *pstart, abi_ulong len, int prot,
+                        int flags, int fd, abi_ulong offset)
+{
+    abi_ulong start = *pstart, hint, addr;
+    void *p;
+    int ret;
+
+    len = TARGET_PAGE_ALIGN(len);
+    if (RESERVED_VA || (flags & MAP_FIXED) || len == 0 ||
+        qemu_host_page_size != qemu_real_host_page_size ||
+        (offset & ~qemu_host_page_mask) != 0) {
+        return 1;
+    }
+
+    /* Give each caller its own hint, otherwise all but one of them
+       would get an address of the kernel's choosing, which may be
+       outside the guest address space.  */
+    mmap_lock();
+    if (start == 0) {
+        hint = mmap_next_start;
+        mmap_next_start += len;
+    } else {
+        hint = start & qemu_host_page_mask;
+    }
+    mmap_nofixed_pending++;
+    mmap_unlock();
+
+    p = mmap(g2h(hint), len, prot, flags, fd, offset);
+    if (p == MAP_FAILED) {
+        ret = -1;
+    } else if (!h2g_valid(p) || !h2g_valid((char *)p + len - 1)) {
+        munmap(p, len);
+        ret = 1;
+    } else {
+        ret = 0;
+    }
+
+    mmap_lock();
+    mmap_nofixed_pending--;
+    if (ret == 0) {
+        addr = h2g(p);
+        page_set_flags(addr, addr + len, prot | PAGE_VALID);
+        *pstart = addr;
+    }
+    mmap_unlock();
+    return ret;
+}
+
+/* Called with mmap_lock held after [start, end) has been unmapped.  If
+   this was the last range handed out, move mmap_next_start back over
+   it and over the free pages below it, so that map/unmap churn reuses
+   addresses instead of running through the whole guest address space.
+   Free pages may still be claimed by mmap_nofixed(), so only go past
+   the range itself when no such call is pending.  */
+static void mmap_release_hint(abi_ulong start, abi_ulong end)
+{
+    if (end != mmap_next_start || start < TASK_UNMAPPED_BASE) {
+        return;
+    }
+    if (!mmap_nofixed_pending) {
+        while (start > TASK_UNMAPPED_BASE &&
+               page_get_flags(start - TARGET_PAGE_SIZE) == 0) {
+            start -= TARGET_PAGE_SIZE;
+        }
+    }
+    mmap_next_start = start;
+}
+
 /* NOTE: all the constants are the HOST ones */
 abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
                      int flags, int fd, abi_ulong offset)
@@ -371,6 +448,13 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
     abi_ulong ret, end, real_start, real_end, retaddr, host_offset, host_len;
     unsigned long host_start;
 
+    switch (mmap_nofixed(&start, len, prot, flags, fd, offset)) {
+    case 0:
+        return start;
+    case -1:
+        return -1;
+    }
+
     mmap_lock();
 #ifdef DEBUG_MMAP
     {
@@ -662,8 +746,10 @@ int target_munmap(abi_ulong start, abi_ulong len)
         }
     }
 
-    if (ret == 0)
+    if (ret == 0) {
         page_set_flags(start, start + len, 0);
+        mmap_release_hint(start, start + len);
+    }
     mmap_unlock();
     return ret;
 }
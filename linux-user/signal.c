@@ -612,7 +612,8 @@ int do_sigaction(int sig, const struct target_sigaction *act,
 
         /* we update the host linux signal state */
         host_sig = target_to_host_signal(sig);
-        if (host_sig != SIGSEGV && host_sig != SIGBUS) {
+        if (host_sig != SIGSEGV && host_sig != SIGBUS &&
+            !(host_sig == SIGPROF && tb_profile_hz)) {
             sigfillset(&act1.sa_mask);
             act1.sa_flags = SA_SIGINFO;
             if (k->sa_flags & TARGET_SA_RESTART)
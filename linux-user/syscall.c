@@ -90,6 +90,7 @@ int __clone2(int (*fn)(void *), void *child_stack_base,
 #include <linux/kd.h>
 #include <linux/mtio.h>
 #include <linux/fs.h>
+#include <linux/aio_abi.h>
 #if defined(CONFIG_FIEMAP)
 #include <linux/fiemap.h>
 #endif
@@ -250,6 +251,26 @@ _syscall3(int, sys_sched_setaffinity, pid_t, pid, unsigned int, len,
           unsigned long *, user_mask_ptr);
 _syscall4(int, reboot, int, magic1, int, magic2, unsigned int, cmd,
           void *, arg);
+#if defined(TARGET_NR_io_setup) && defined(__NR_io_setup) && \
+    TARGET_ABI_BITS == HOST_LONG_BITS && !defined(BSWAP_NEEDED)
+/* The AIO structures have the same layout on all hosts of one
+   endianness, and the context and the iocb pointer array are pointer
+   sized, so the guest's can be handed to the host kernel.  */
+#define TARGET_AIO_IS_HOST
+#define __NR_sys_io_setup __NR_io_setup
+#define __NR_sys_io_destroy __NR_io_destroy
+#define __NR_sys_io_submit __NR_io_submit
+#define __NR_sys_io_cancel __NR_io_cancel
+#define __NR_sys_io_getevents __NR_io_getevents
+_syscall2(int, sys_io_setup, unsigned int, nr_events, aio_context_t *, ctxp)
+_syscall1(int, sys_io_destroy, aio_context_t, ctx)
+_syscall3(int, sys_io_submit, aio_context_t, ctx, long, nr,
+          struct iocb **, iocbpp)
+_syscall3(int, sys_io_cancel, aio_context_t, ctx, struct iocb *, iocb,
+          struct io_event *, result)
+_syscall5(int, sys_io_getevents, aio_context_t, ctx, long, min_nr, long, nr,
+          struct io_event *, events, struct timespec *, timeout)
+#endif
 
 static bitmask_transtbl fcntl_flags_tbl[] = {
   { TARGET_O_ACCMODE,   TARGET_O_WRONLY,    O_ACCMODE,   O_WRONLY,    },
@@ -1701,12 +1722,23 @@ static abi_long do_getsockopt(int sockfd, int level, int optname,
     return ret;
 }
 
-/* FIXME
- * lock_iovec()/unlock_iovec() have a return code of 0 for success where
- * other lock functions have a return code of 0 for failure.
- */
-static abi_long lock_iovec(int type, struct iovec *vec, abi_ulong target_addr,
-                           int count, int copy)
+/* The guest iovec array can be handed to the host unchanged when both
+   use the same layout and guest addresses are host addresses.  */
+#if TARGET_ABI_BITS == HOST_LONG_BITS && !defined(BSWAP_NEEDED) && \
+    !defined(DEBUG_REMAP)
+#define TARGET_IOVEC_IS_HOST (GUEST_BASE == 0)
+QEMU_BUILD_BUG_ON(sizeof(struct target_iovec) != sizeof(struct iovec));
+#else
+#define TARGET_IOVEC_IS_HOST 0
+#endif
+
+/* Return a host iovec array for the 'count' guest iovecs at
+   'target_addr', or NULL if the guest array is not accessible.  This is
+   the guest array itself if all the buffers are accessible and no
+   conversion is needed, otherwise 'vec' filled in with the host
+   addresses.  */
+static struct iovec *lock_iovec(int type, struct iovec *vec,
+                                abi_ulong target_addr, int count, int copy)
 {
     struct target_iovec *target_vec;
     abi_ulong base;
@@ -1714,7 +1746,19 @@ static abi_long lock_iovec(int type, struct iovec *vec, abi_ulong target_addr,
 
     target_vec = lock_user(VERIFY_READ, target_addr, count * sizeof(struct target_iovec), 1);
     if (!target_vec)
-        return -TARGET_EFAULT;
+        return NULL;
+    if (TARGET_IOVEC_IS_HOST) {
+        for (i = 0; i < count; i++) {
+            if (target_vec[i].iov_len != 0 &&
+                !access_ok(type, target_vec[i].iov_base,
+                           target_vec[i].iov_len)) {
+                break;
+            }
+        }
+        if (i == count) {
+            return (struct iovec *)target_vec;
+        }
+    }
     for(i = 0;i < count; i++) {
         base = tswapal(target_vec[i].iov_base);
         vec[i].iov_len = tswapal(target_vec[i].iov_len);
@@ -1728,7 +1772,7 @@ static abi_long lock_iovec(int type, struct iovec *vec, abi_ulong target_addr,
         }
     }
     unlock_user (target_vec, target_addr, 0);
-    return 0;
+    return vec;
 }
 
 static abi_long unlock_iovec(struct iovec *vec, abi_ulong target_addr,
@@ -1738,6 +1782,10 @@ static abi_long unlock_iovec(struct iovec *vec, abi_ulong target_addr,
     abi_ulong base;
     int i;
 
+    if (vec == g2h(target_addr)) {
+        /* the guest array was used directly */
+        return 0;
+    }
     target_vec = lock_user(VERIFY_READ, target_addr, count * sizeof(struct target_iovec), 1);
     if (!target_vec)
         return -TARGET_EFAULT;
@@ -1857,9 +1905,18 @@ static abi_long do_sendrecvmsg(int fd, abi_ulong target_msg,
     msg.msg_flags = tswap32(msgp->msg_flags);
 
     count = tswapal(msgp->msg_iovlen);
+    if (count < 0 || count > IOV_MAX) {
+        unlock_user_struct(msgp, target_msg, send ? 0 : 1);
+        return -TARGET_EMSGSIZE;
+    }
     vec = alloca(count * sizeof(struct iovec));
     target_vec = tswapal(msgp->msg_iov);
-    lock_iovec(send ? VERIFY_READ : VERIFY_WRITE, vec, target_vec, count, send);
+    vec = lock_iovec(send ? VERIFY_READ : VERIFY_WRITE, vec, target_vec,
+                     count, send);
+    if (!vec) {
+        unlock_user_struct(msgp, target_msg, send ? 0 : 1);
+        return -TARGET_EFAULT;
+    }
     msg.msg_iovlen = count;
     msg.msg_iov = vec;
 
@@ -3021,8 +3078,10 @@ static inline abi_ulong do_shmat(int shmid, abi_ulong shmaddr, int shmflg)
 
 static inline abi_long do_shmdt(abi_ulong shmaddr)
 {
+    abi_long ret;
     int i;
 
+    mmap_lock();
     for (i = 0; i < N_SHM_REGIONS; ++i) {
         if (shm_regions[i].start == shmaddr) {
             shm_regions[i].start = 0;
@@ -3030,8 +3089,10 @@ static inline abi_long do_shmdt(abi_ulong shmaddr)
             break;
         }
     }
+    ret = get_errno(shmdt(g2h(shmaddr)));
+    mmap_unlock();
 
-    return get_errno(shmdt(g2h(shmaddr)));
+    return ret;
 }
 
 #ifdef TARGET_NR_ipc
@@ -4592,6 +4653,144 @@ static int do_futex(target_ulong uaddr, int op, int val, target_ulong timeout,
 }
 #endif
 
+#ifdef TARGET_AIO_IS_HOST
+/* Check that the buffers of the 'count' guest iovecs at 'addr' are
+   accessible, unprotecting pages with translated code if needed.  */
+static int aio_iovec_ok(int type, abi_ulong addr, abi_ulong count)
+{
+    struct target_iovec *vec;
+    abi_ulong i;
+
+    if (count > IOV_MAX) {
+        /* rejected by the host kernel */
+        return 1;
+    }
+    vec = lock_user(VERIFY_READ, addr, count * sizeof(*vec), 1);
+    if (!vec) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (vec[i].iov_len != 0 &&
+            !access_ok(type, vec[i].iov_base, vec[i].iov_len)) {
+            break;
+        }
+    }
+    unlock_user(vec, addr, 0);
+    return i == count;
+}
+
+/* Return how many of the 'nr' guest iocbs in 'iocbpp' can be handed to
+   the host kernel, which accesses their buffers directly, possibly
+   after io_submit() has returned.  Like the kernel, stop at the first
+   invalid one.  */
+static long aio_check_iocbs(abi_ulong *iocbpp, long nr)
+{
+    struct iocb *cb;
+    long i;
+    int ok;
+
+    for (i = 0; i < nr; i++) {
+        /* the host writes aio_key back */
+        if (!access_ok(VERIFY_WRITE, iocbpp[i], sizeof(struct iocb))) {
+            break;
+        }
+        cb = g2h(iocbpp[i]);
+        switch (cb->aio_lio_opcode) {
+        case IOCB_CMD_PREAD:
+            ok = access_ok(VERIFY_WRITE, cb->aio_buf, cb->aio_nbytes);
+            break;
+        case IOCB_CMD_PWRITE:
+            ok = access_ok(VERIFY_READ, cb->aio_buf, cb->aio_nbytes);
+            break;
+        case IOCB_CMD_PREADV:
+            ok = aio_iovec_ok(VERIFY_WRITE, cb->aio_buf, cb->aio_nbytes);
+            break;
+        case IOCB_CMD_PWRITEV:
+            ok = aio_iovec_ok(VERIFY_READ, cb->aio_buf, cb->aio_nbytes);
+            break;
+        default:
+            /* no buffer, or an opcode the host rejects */
+            ok = 1;
+            break;
+        }
+        if (!ok) {
+            break;
+        }
+    }
+    return i;
+}
+
+/* io_setup() and friends.  The whole batch of an io_submit() goes to
+   the host in one call.  This needs guest addresses to be host
+   addresses.  */
+static abi_long do_aio(int num, abi_long arg1, abi_long arg2, abi_long arg3,
+                       abi_long arg4, abi_long arg5)
+{
+    struct timespec ts, *pts;
+    aio_context_t ctx;
+    abi_ulong *iocbpp;
+    abi_long ret;
+    long nr;
+
+    if (GUEST_BASE != 0) {
+        return -TARGET_ENOSYS;
+    }
+    switch (num) {
+    case TARGET_NR_io_setup:
+        if (get_user_ual(ctx, arg2)) {
+            return -TARGET_EFAULT;
+        }
+        ret = get_errno(sys_io_setup(arg1, &ctx));
+        if (!is_error(ret) && put_user_ual(ctx, arg2)) {
+            sys_io_destroy(ctx);
+            return -TARGET_EFAULT;
+        }
+        return ret;
+    case TARGET_NR_io_destroy:
+        return get_errno(sys_io_destroy(arg1));
+    case TARGET_NR_io_submit:
+        if (arg2 < 0) {
+            return -TARGET_EINVAL;
+        }
+        iocbpp = lock_user(VERIFY_READ, arg3, arg2 * sizeof(abi_ulong), 1);
+        if (!iocbpp) {
+            return -TARGET_EFAULT;
+        }
+        nr = aio_check_iocbs(iocbpp, arg2);
+        if (nr == 0 && arg2 != 0) {
+            ret = -TARGET_EFAULT;
+        } else {
+            ret = get_errno(sys_io_submit(arg1, nr, (struct iocb **)iocbpp));
+        }
+        unlock_user(iocbpp, arg3, 0);
+        return ret;
+    case TARGET_NR_io_cancel:
+        if (!access_ok(VERIFY_READ, arg2, sizeof(struct iocb)) ||
+            !access_ok(VERIFY_WRITE, arg3, sizeof(struct io_event))) {
+            return -TARGET_EFAULT;
+        }
+        return get_errno(sys_io_cancel(arg1, g2h(arg2), g2h(arg3)));
+    case TARGET_NR_io_getevents:
+        if (arg3 < 0) {
+            return -TARGET_EINVAL;
+        }
+        if (!access_ok(VERIFY_WRITE, arg4, arg3 * sizeof(struct io_event))) {
+            return -TARGET_EFAULT;
+        }
+        pts = NULL;
+        if (arg5) {
+            if (target_to_host_timespec(&ts, arg5)) {
+                return -TARGET_EFAULT;
+            }
+            pts = &ts;
+        }
+        return get_errno(sys_io_getevents(arg1, arg2, arg3, g2h(arg4), pts));
+    default:
+        return -TARGET_ENOSYS;
+    }
+}
+#endif
+
 /* Map host to target signal numbers for the wait family of syscalls.
    Assume all other status bits are the same.  */
 static int host_to_target_waitstatus(int status)
@@ -4808,6 +5007,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
                         NULL, NULL, 0);
           }
           thread_env = NULL;
+          g_free(((CPUState *)cpu_env)->tb_jmp_cache);
           g_free(cpu_env);
           g_free(ts);
           pthread_exit(NULL);
@@ -4817,6 +5017,9 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         _mcleanup();
 #endif
         gdb_exit(cpu_env, arg1);
+        tb_cache_save();
+        tb_profile_save();
+        tb_perf_map_flush();
         _exit(arg1);
         ret = 0; /* avoid warning */
         break;
@@ -6560,6 +6763,9 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         _mcleanup();
 #endif
         gdb_exit(cpu_env, arg1);
+        tb_cache_save();
+        tb_profile_save();
+        tb_perf_map_flush();
         ret = get_errno(exit_group(arg1));
         break;
 #endif
@@ -6847,8 +7053,13 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             int count = arg3;
             struct iovec *vec;
 
+            if (count < 0 || count > IOV_MAX) {
+                ret = -TARGET_EINVAL;
+                break;
+            }
             vec = alloca(count * sizeof(struct iovec));
-            if (lock_iovec(VERIFY_WRITE, vec, arg2, count, 0) < 0)
+            vec = lock_iovec(VERIFY_WRITE, vec, arg2, count, 0);
+            if (!vec)
                 goto efault;
             ret = get_errno(readv(arg1, vec, count));
             unlock_iovec(vec, arg2, count, 1);
@@ -6859,8 +7070,13 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             int count = arg3;
             struct iovec *vec;
 
+            if (count < 0 || count > IOV_MAX) {
+                ret = -TARGET_EINVAL;
+                break;
+            }
             vec = alloca(count * sizeof(struct iovec));
-            if (lock_iovec(VERIFY_READ, vec, arg2, count, 1) < 0)
+            vec = lock_iovec(VERIFY_READ, vec, arg2, count, 1);
+            if (!vec)
                 goto efault;
             ret = get_errno(writev(arg1, vec, count));
             unlock_iovec(vec, arg2, count, 0);
@@ -8094,6 +8310,15 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         ret = do_futex(arg1, arg2, arg3, arg4, arg5, arg6);
         break;
 #endif
+#ifdef TARGET_AIO_IS_HOST
+    case TARGET_NR_io_setup:
+    case TARGET_NR_io_destroy:
+    case TARGET_NR_io_submit:
+    case TARGET_NR_io_cancel:
+    case TARGET_NR_io_getevents:
+        ret = do_aio(num, arg1, arg2, arg3, arg4, arg5);
+        break;
+#endif
 #if defined(TARGET_NR_inotify_init) && defined(__NR_inotify_init)
     case TARGET_NR_inotify_init:
         ret = get_errno(sys_inotify_init());
@@ -8225,8 +8450,13 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             int count = arg3;
             struct iovec *vec;
 
+            if (count < 0 || count > IOV_MAX) {
+                ret = -TARGET_EINVAL;
+                break;
+            }
             vec = alloca(count * sizeof(struct iovec));
-            if (lock_iovec(VERIFY_READ, vec, arg2, count, 1) < 0)
+            vec = lock_iovec(VERIFY_READ, vec, arg2, count, 1);
+            if (!vec)
                 goto efault;
             ret = get_errno(vmsplice(arg1, vec, count, arg4));
             unlock_iovec(vec, arg2, count, 0);
@@ -8317,6 +8547,16 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 #if defined(TARGET_NR_epoll_pwait) && defined(CONFIG_EPOLL_PWAIT)
 #define IMPLEMENT_EPOLL_PWAIT
 #endif
+/* When the layouts match, the host kernel stores the events straight
+   into the guest buffer.  */
+#ifdef BSWAP_NEEDED
+#define TARGET_EPOLL_EVENT_IS_HOST 0
+#else
+#define TARGET_EPOLL_EVENT_IS_HOST                                      \
+    (sizeof(struct target_epoll_event) == sizeof(struct epoll_event) &&  \
+     offsetof(struct target_epoll_event, data) ==                       \
+     offsetof(struct epoll_event, data))
+#endif
 #if defined(TARGET_NR_epoll_wait) || defined(IMPLEMENT_EPOLL_PWAIT)
 #if defined(TARGET_NR_epoll_wait)
     case TARGET_NR_epoll_wait:
@@ -8331,13 +8571,27 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         int maxevents = arg3;
         int timeout = arg4;
 
+        if (maxevents <= 0 ||
+            maxevents > INT_MAX / sizeof(struct target_epoll_event)) {
+            ret = -TARGET_EINVAL;
+            break;
+        }
         target_ep = lock_user(VERIFY_WRITE, arg2,
                               maxevents * sizeof(struct target_epoll_event), 1);
         if (!target_ep) {
             goto efault;
         }
 
-        ep = alloca(maxevents * sizeof(struct epoll_event));
+        if (TARGET_EPOLL_EVENT_IS_HOST) {
+            ep = (struct epoll_event *)target_ep;
+        } else {
+            ep = g_try_malloc(maxevents * sizeof(struct epoll_event));
+            if (!ep) {
+                unlock_user(target_ep, arg2, 0);
+                ret = -TARGET_ENOMEM;
+                break;
+            }
+        }
 
         switch (num) {
 #if defined(IMPLEMENT_EPOLL_PWAIT)
@@ -8350,6 +8604,9 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
                 target_set = lock_user(VERIFY_READ, arg5,
                                        sizeof(target_sigset_t), 1);
                 if (!target_set) {
+                    if (!TARGET_EPOLL_EVENT_IS_HOST) {
+                        g_free(ep);
+                    }
                     unlock_user(target_ep, arg2, 0);
                     goto efault;
                 }
@@ -8371,12 +8628,15 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         default:
             ret = -TARGET_ENOSYS;
         }
-        if (!is_error(ret)) {
-            int i;
-            for (i = 0; i < ret; i++) {
-                target_ep[i].events = tswap32(ep[i].events);
-                target_ep[i].data.u64 = tswap64(ep[i].data.u64);
+        if (!TARGET_EPOLL_EVENT_IS_HOST) {
+            if (!is_error(ret)) {
+                int i;
+                for (i = 0; i < ret; i++) {
+                    target_ep[i].events = tswap32(ep[i].events);
+                    target_ep[i].data.u64 = tswap64(ep[i].data.u64);
+                }
             }
+            g_free(ep);
         }
         unlock_user(target_ep, arg2, ret * sizeof(struct target_epoll_event));
         break;
@@ -2327,11 +2327,20 @@ typedef union target_epoll_data {
     uint64_t u64;
 } target_epoll_data_t;
 
+#if defined(TARGET_I386)
+/* i386 aligns 64-bit fields to 4 bytes and x86_64 packs the structure,
+   so both have the data right after the events.  */
+struct target_epoll_event {
+    uint32_t events;
+    target_epoll_data_t data;
+} QEMU_PACKED;
+#else
 struct target_epoll_event {
     uint32_t events;
     target_epoll_data_t data;
 };
 #endif
+#endif
 struct target_rlimit64 {
     uint64_t rlim_cur;
     uint64_t rlim_max;
@@ -776,6 +776,11 @@ static void do_info_jit(Monitor *mon)
     dump_exec_info((FILE *)mon, monitor_fprintf);
 }
 
+static void do_info_jit_profile(Monitor *mon)
+{
+    dump_jit_profile((FILE *)mon, monitor_fprintf, 20);
+}
+
 static void do_info_history(Monitor *mon)
 {
     int i;
@@ -2414,6 +2419,13 @@ static mon_cmd_t info_cmds[] = {
         .help       = "show dynamic compiler info",
         .mhandler.info = do_info_jit,
     },
+    {
+        .name       = "jit-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the translated blocks where most time is spent",
+        .mhandler.info = do_info_jit_profile,
+    },
     {
         .name       = "kvm",
         .args_type  = "",
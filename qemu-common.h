@@ -259,6 +259,11 @@ typedef enum LostTickPolicy {
 } LostTickPolicy;
 
 void tcg_exec_init(unsigned long tb_size);
+int tb_jmp_cache_set_bits(unsigned int bits);
+void tb_perf_map_enable(void);
+int tb_profile_configure(const char *opts);
+void tb_profile_start(void);
+void dump_jit_profile(FILE *f, fprintf_function cpu_fprintf, int max);
 bool tcg_enabled(void);
 
 void cpu_exec_init_all(void);
@@ -113,6 +113,19 @@ static QemuOptsList qemu_drive_opts = {
             .name = "copy-on-read",
             .type = QEMU_OPT_BOOL,
             .help = "copy read data from backing file into image file",
+        },{
+            .name = "l2-cache-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "size of the qcow2 L2 table cache",
+        },{
+            .name = "refcount-cache-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "size of the qcow2 refcount block cache",
+        },{
+            .name = "cache-clean-interval",
+            .type = QEMU_OPT_NUMBER,
+            .help = "seconds between background writebacks of dirty "
+                    "metadata cache entries",
         },
         { /* end of list */ }
     },
@@ -84,6 +84,9 @@ static void help(void)
            "  '-p' show progress of command (only certain commands)\n"
            "  '-S' indicates the consecutive number of bytes that must contain only zeros\n"
            "       for qemu-img to create a sparse image during conversion\n"
+           "  '-m' specifies how many coroutines work in parallel during the convert\n"
+           "       process (defaults to 8)\n"
+           "  '-W' allows to write to the target out of order rather than sequential\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
            "  'snapshot' is the name of the snapshot to create, apply or delete\n"
@@ -615,18 +618,343 @@ static int compare_sectors(const uint8_t *buf1, const uint8_t *buf2, int n,
 }
 
 #define IO_BUF_SIZE (2 * 1024 * 1024)
+/* Compressed output is written in batches of clusters, which the image
+ * format can compress in parallel */
+#define COMPRESS_BUF_SIZE (16 * 1024 * 1024)
+
+/*
+ * Conversion of uncompressed images is done by several coroutines at once.
+ * They each claim the next chunk of the image, read it from the source and
+ * write it to the target, so that several reads and writes are in flight at
+ * any time. The allocation status of the source is looked up for whole runs
+ * of sectors, so that unallocated or zero areas are skipped in one step
+ * instead of being read and scanned for zeroes.
+ */
+#define MAX_COROUTINES 16
+#define DEFAULT_COROUTINES 8
+
+typedef enum ImgConvertBlockStatus {
+    BLK_DATA,
+    BLK_ZERO,
+    BLK_BACKING_FILE,
+} ImgConvertBlockStatus;
+
+typedef struct ImgConvertState {
+    BlockDriverState **src;
+    int64_t *src_sectors;
+    int src_num;
+    int64_t total_sectors;
+    int64_t sector_num;
+    int64_t sector_next_status;
+    int64_t sectors_done;
+    ImgConvertBlockStatus status;
+    BlockDriverState *target;
+    bool has_zero_init;
+    bool target_has_backing;
+    bool wr_in_order;
+    int64_t wr_offs;
+    int min_sparse;
+    int buf_sectors;
+    int num_coroutines;
+    int running_coroutines;
+    Coroutine *co[MAX_COROUTINES];
+    int64_t wait_sector_num[MAX_COROUTINES];
+    CoMutex lock;
+    int ret;
+} ImgConvertState;
+
+static void convert_select_part(ImgConvertState *s, int64_t sector_num,
+                                int *src_cur, int64_t *src_cur_offset)
+{
+    *src_cur = 0;
+    *src_cur_offset = 0;
+    while (sector_num - *src_cur_offset >= s->src_sectors[*src_cur]) {
+        *src_cur_offset += s->src_sectors[*src_cur];
+        (*src_cur)++;
+        assert(*src_cur < s->src_num);
+    }
+}
+
+/*
+ * Returns the number of sectors starting at sector_num that can be handled
+ * in one step and sets s->status to their allocation status. Chunks never
+ * cross the boundary between two source images.
+ */
+static int coroutine_fn convert_iteration_sectors(ImgConvertState *s,
+                                                  int64_t sector_num)
+{
+    BlockDriverState *bs, *backing;
+    int64_t src_cur_offset, src_num;
+    int src_cur, n, pnum, ret;
+
+    convert_select_part(s, sector_num, &src_cur, &src_cur_offset);
+    bs = s->src[src_cur];
+    src_num = sector_num - src_cur_offset;
+    n = MIN(s->src_sectors[src_cur] - src_num, INT_MAX / BDRV_SECTOR_SIZE);
+
+    if (s->sector_next_status <= sector_num) {
+        ret = bdrv_co_is_allocated(bs, src_num, n, &n);
+        if (ret < 0) {
+            return ret;
+        }
+
+        if (ret) {
+            s->status = BLK_DATA;
+        } else if (s->target_has_backing && bs->backing_hd) {
+            /* The target's backing file is assumed to have the same content
+             * as the source's, so the target doesn't need the data */
+            s->status = BLK_BACKING_FILE;
+        } else {
+            /* Either the data comes from a backing file of the source or
+             * the sectors read as zeroes */
+            s->status = BLK_ZERO;
+            for (backing = bs->backing_hd; backing;
+                 backing = backing->backing_hd) {
+                ret = bdrv_co_is_allocated(backing, src_num, n, &pnum);
+                if (ret < 0) {
+                    return ret;
+                }
+                if (pnum == 0) {
+                    /* beyond the end of a shorter backing file */
+                    break;
+                }
+                n = pnum;
+                if (ret) {
+                    s->status = BLK_DATA;
+                    break;
+                }
+            }
+        }
+        s->sector_next_status = sector_num + n;
+    }
+
+    n = MIN(n, s->sector_next_status - sector_num);
+    if (s->status == BLK_DATA ||
+        (s->status == BLK_ZERO &&
+         (!s->has_zero_init || s->target_has_backing))) {
+        n = MIN(n, s->buf_sectors);
+    }
+
+    return n;
+}
+
+static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
+                                        int nb_sectors, uint8_t *buf)
+{
+    QEMUIOVector qiov;
+    struct iovec iov;
+    int64_t src_cur_offset;
+    int src_cur;
+
+    convert_select_part(s, sector_num, &src_cur, &src_cur_offset);
+    assert(sector_num - src_cur_offset + nb_sectors <=
+           s->src_sectors[src_cur]);
+
+    iov.iov_base = buf;
+    iov.iov_len = nb_sectors * BDRV_SECTOR_SIZE;
+    qemu_iovec_init_external(&qiov, &iov, 1);
+
+    return bdrv_co_readv(s->src[src_cur], sector_num - src_cur_offset,
+                         nb_sectors, &qiov);
+}
+
+static int coroutine_fn convert_co_write(ImgConvertState *s,
+                                         int64_t sector_num, int nb_sectors,
+                                         uint8_t *buf,
+                                         ImgConvertBlockStatus status)
+{
+    QEMUIOVector qiov;
+    struct iovec iov;
+    int ret, n;
+
+    /* The target reads these sectors from its own backing file */
+    if (status == BLK_BACKING_FILE) {
+        return 0;
+    }
+
+    /* Zeroes only have to be written if the target doesn't read as zero
+     * already, or if they must hide data in the target's backing file */
+    if (status == BLK_ZERO) {
+        if (s->has_zero_init && !s->target_has_backing) {
+            return 0;
+        }
+        return bdrv_co_write_zeroes(s->target, sector_num, nb_sectors);
+    }
+
+    while (nb_sectors > 0) {
+        n = nb_sectors;
+
+        /* NOTE: at the same time we convert, we do not write zero
+           sectors to have a chance to compress the image. */
+        if (!s->has_zero_init || s->target_has_backing ||
+            is_allocated_sectors_min(buf, n, &n, s->min_sparse)) {
+            iov.iov_base = buf;
+            iov.iov_len = n * BDRV_SECTOR_SIZE;
+            qemu_iovec_init_external(&qiov, &iov, 1);
+
+            ret = bdrv_co_writev(s->target, sector_num, n, &qiov);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        sector_num += n;
+        nb_sectors -= n;
+        buf += n * BDRV_SECTOR_SIZE;
+    }
+
+    return 0;
+}
+
+/* Reenters a coroutine that waits for the target to be written up to
+ * sector_num, or all waiting coroutines if sector_num is -1 */
+static void convert_wake_waiters(ImgConvertState *s, int64_t sector_num)
+{
+    int i;
+
+    for (i = 0; i < s->num_coroutines; i++) {
+        if (s->co[i] && s->wait_sector_num[i] != -1 &&
+            (sector_num == -1 || s->wait_sector_num[i] == sector_num)) {
+            qemu_coroutine_enter(s->co[i], NULL);
+            if (sector_num != -1) {
+                break;
+            }
+        }
+    }
+}
+
+static void coroutine_fn convert_co_do_copy(void *opaque)
+{
+    ImgConvertState *s = opaque;
+    uint8_t *buf;
+    int ret, i, index = -1;
+
+    for (i = 0; i < s->num_coroutines; i++) {
+        if (s->co[i] == qemu_coroutine_self()) {
+            index = i;
+            break;
+        }
+    }
+    assert(index >= 0);
+
+    buf = qemu_blockalign(s->target, s->buf_sectors * BDRV_SECTOR_SIZE);
+
+    while (s->ret == -EINPROGRESS) {
+        ImgConvertBlockStatus status;
+        int64_t sector_num;
+        int n;
+
+        qemu_co_mutex_lock(&s->lock);
+        if (s->ret != -EINPROGRESS || s->sector_num >= s->total_sectors) {
+            qemu_co_mutex_unlock(&s->lock);
+            break;
+        }
+        n = convert_iteration_sectors(s, s->sector_num);
+        if (n < 0) {
+            qemu_co_mutex_unlock(&s->lock);
+            if (s->ret == -EINPROGRESS) {
+                error_report("error while reading block status of sector %"
+                             PRId64 ": %s", s->sector_num, strerror(-n));
+                s->ret = n;
+            }
+            break;
+        }
+        sector_num = s->sector_num;
+        status = s->status;
+        s->sector_num += n;
+        qemu_co_mutex_unlock(&s->lock);
+
+        if (status == BLK_DATA) {
+            ret = convert_co_read(s, sector_num, n, buf);
+            if (ret < 0 && s->ret == -EINPROGRESS) {
+                error_report("error while reading sector %" PRId64 ": %s",
+                             sector_num, strerror(-ret));
+                s->ret = ret;
+            }
+        }
+
+        if (s->wr_in_order) {
+            /* keep writes in order */
+            while (s->wr_offs != sector_num && s->ret == -EINPROGRESS) {
+                s->wait_sector_num[index] = sector_num;
+                qemu_coroutine_yield();
+            }
+            s->wait_sector_num[index] = -1;
+        }
+
+        if (s->ret == -EINPROGRESS) {
+            ret = convert_co_write(s, sector_num, n, buf, status);
+            if (ret < 0 && s->ret == -EINPROGRESS) {
+                error_report("error while writing sector %" PRId64 ": %s",
+                             sector_num, strerror(-ret));
+                s->ret = ret;
+            }
+        }
+
+        if (s->ret == -EINPROGRESS) {
+            s->sectors_done += n;
+            qemu_progress_print(100.0 * s->sectors_done / s->total_sectors, 0);
+            if (s->wr_in_order) {
+                /* reenter the coroutine that may wait for this write */
+                s->wr_offs = sector_num + n;
+                convert_wake_waiters(s, s->wr_offs);
+            }
+        }
+    }
+
+    /* let coroutines that wait for their turn see the error */
+    if (s->ret != -EINPROGRESS) {
+        convert_wake_waiters(s, -1);
+    }
+
+    qemu_vfree(buf);
+    s->co[index] = NULL;
+    s->running_coroutines--;
+    if (!s->running_coroutines && s->ret == -EINPROGRESS) {
+        s->ret = 0;
+    }
+}
+
+static int convert_do_copy(ImgConvertState *s)
+{
+    int i;
+
+    s->ret = -EINPROGRESS;
+    s->sector_num = 0;
+    s->sector_next_status = 0;
+    s->sectors_done = 0;
+    s->wr_offs = 0;
+    qemu_co_mutex_init(&s->lock);
+
+    for (i = 0; i < s->num_coroutines; i++) {
+        s->co[i] = qemu_coroutine_create(convert_co_do_copy);
+        s->wait_sector_num[i] = -1;
+    }
+
+    s->running_coroutines = s->num_coroutines;
+    for (i = 0; i < s->num_coroutines; i++) {
+        qemu_coroutine_enter(s->co[i], s);
+    }
+
+    while (s->running_coroutines) {
+        qemu_aio_wait();
+    }
+
+    return s->ret;
+}
 
 static int img_convert(int argc, char **argv)
 {
-    int c, ret = 0, n, n1, bs_n, bs_i, compress, cluster_size, cluster_sectors;
+    int c, ret = 0, n, bs_n, bs_i, compress, cluster_size, cluster_sectors;
     int progress = 0, flags;
     const char *fmt, *out_fmt, *cache, *out_baseimg, *out_filename;
     BlockDriver *drv, *proto_drv;
     BlockDriverState **bs = NULL, *out_bs = NULL;
-    int64_t total_sectors, nb_sectors, sector_num, bs_offset;
+    int64_t total_sectors, nb_sectors, sector_num, bs_offset, batch_sector;
+    int batch, batch_max;
     uint64_t bs_sectors;
+    int64_t *bs_sectors_tab = NULL;
     uint8_t * buf = NULL;
-    const uint8_t *buf1;
     BlockDriverInfo bdi;
     QEMUOptionParameter *param = NULL, *create_options = NULL;
     QEMUOptionParameter *out_baseimg_param;
@@ -634,6 +962,8 @@ static int img_convert(int argc, char **argv)
     const char *snapshot_name = NULL;
     float local_progress;
     int min_sparse = 8; /* Need at least 4k of zeros for sparse detection */
+    int num_coroutines = DEFAULT_COROUTINES;
+    bool wr_in_order = true;
 
     fmt = NULL;
     out_fmt = "raw";
@@ -641,7 +971,7 @@ static int img_convert(int argc, char **argv)
     out_baseimg = NULL;
     compress = 0;
     for(;;) {
-        c = getopt(argc, argv, "f:O:B:s:hce6o:pS:t:");
+        c = getopt(argc, argv, "f:O:B:s:hce6o:pS:t:m:W");
         if (c == -1) {
             break;
         }
@@ -695,6 +1025,22 @@ static int img_convert(int argc, char **argv)
         case 't':
             cache = optarg;
             break;
+        case 'm':
+        {
+            char *end;
+            num_coroutines = strtol(optarg, &end, 10);
+            if (*end || num_coroutines < 1 ||
+                num_coroutines > MAX_COROUTINES) {
+                error_report("Invalid number of coroutines. Allowed number of"
+                             " coroutines is between 1 and %d",
+                             MAX_COROUTINES);
+                return 1;
+            }
+            break;
+        }
+        case 'W':
+            wr_in_order = false;
+            break;
         }
     }
 
@@ -721,6 +1067,7 @@ static int img_convert(int argc, char **argv)
     qemu_progress_print(0, 100);
 
     bs = g_malloc0(bs_n * sizeof(BlockDriverState *));
+    bs_sectors_tab = g_malloc0(bs_n * sizeof(int64_t));
 
     total_sectors = 0;
     for (bs_i = 0; bs_i < bs_n; bs_i++) {
@@ -731,6 +1078,7 @@ static int img_convert(int argc, char **argv)
             goto out;
         }
         bdrv_get_geometry(bs[bs_i], &bs_sectors);
+        bs_sectors_tab[bs_i] = bs_sectors;
         total_sectors += bs_sectors;
     }
 
@@ -849,12 +1197,12 @@ static int img_convert(int argc, char **argv)
         goto out;
     }
 
-    bs_i = 0;
-    bs_offset = 0;
-    bdrv_get_geometry(bs[0], &bs_sectors);
-    buf = qemu_blockalign(out_bs, IO_BUF_SIZE);
-
     if (compress) {
+        bs_i = 0;
+        bs_offset = 0;
+        bdrv_get_geometry(bs[0], &bs_sectors);
+        buf = qemu_blockalign(out_bs, COMPRESS_BUF_SIZE);
+
         ret = bdrv_get_info(out_bs, &bdi);
         if (ret < 0) {
             error_report("could not get block driver info");
@@ -867,6 +1215,9 @@ static int img_convert(int argc, char **argv)
             goto out;
         }
         cluster_sectors = cluster_size >> 9;
+        batch_max = COMPRESS_BUF_SIZE / cluster_size;
+        batch = 0;
+        batch_sector = 0;
         sector_num = 0;
 
         nb_sectors = total_sectors;
@@ -875,8 +1226,8 @@ static int img_convert(int argc, char **argv)
 
         for(;;) {
             int64_t bs_num;
-            int remainder;
-            uint8_t *buf2;
+            int remainder, is_zero;
+            uint8_t *cluster_buf, *buf2;
 
             nb_sectors = total_sectors - sector_num;
             if (nb_sectors <= 0)
@@ -889,7 +1240,8 @@ static int img_convert(int argc, char **argv)
             bs_num = sector_num - bs_offset;
             assert (bs_num >= 0);
             remainder = n;
-            buf2 = buf;
+            cluster_buf = buf + batch * cluster_size;
+            buf2 = cluster_buf;
             while (remainder > 0) {
                 int nlow;
                 while (bs_num == bs_sectors) {
@@ -921,107 +1273,50 @@ static int img_convert(int argc, char **argv)
             assert (remainder == 0);
 
             if (n < cluster_sectors) {
-                memset(buf + n * 512, 0, cluster_size - n * 512);
+                memset(cluster_buf + n * 512, 0, cluster_size - n * 512);
+            }
+            is_zero = buffer_is_zero(cluster_buf, cluster_size);
+            if (!is_zero) {
+                if (batch == 0) {
+                    batch_sector = sector_num;
+                }
+                batch++;
             }
-            if (!buffer_is_zero(buf, cluster_size)) {
-                ret = bdrv_write_compressed(out_bs, sector_num, buf,
-                                            cluster_sectors);
+            sector_num += n;
+
+            /* write out the batch once it is full or the run of non-zero
+               clusters ends */
+            if (batch > 0 &&
+                (is_zero || batch == batch_max || sector_num >= total_sectors)) {
+                ret = bdrv_write_compressed(out_bs, batch_sector, buf,
+                                            batch * cluster_sectors);
                 if (ret != 0) {
                     error_report("error while compressing sector %" PRId64
-                                 ": %s", sector_num, strerror(-ret));
+                                 ": %s", batch_sector, strerror(-ret));
                     goto out;
                 }
+                batch = 0;
             }
-            sector_num += n;
             qemu_progress_print(local_progress, 100);
         }
         /* signal EOF to align */
         bdrv_write_compressed(out_bs, 0, NULL, 0);
     } else {
-        int has_zero_init = bdrv_has_zero_init(out_bs);
-
-        sector_num = 0; // total number of sectors converted so far
-        nb_sectors = total_sectors - sector_num;
-        local_progress = (float)100 /
-            (nb_sectors / MIN(nb_sectors, IO_BUF_SIZE / 512));
-
-        for(;;) {
-            nb_sectors = total_sectors - sector_num;
-            if (nb_sectors <= 0) {
-                break;
-            }
-            if (nb_sectors >= (IO_BUF_SIZE / 512)) {
-                n = (IO_BUF_SIZE / 512);
-            } else {
-                n = nb_sectors;
-            }
-
-            while (sector_num - bs_offset >= bs_sectors) {
-                bs_i ++;
-                assert (bs_i < bs_n);
-                bs_offset += bs_sectors;
-                bdrv_get_geometry(bs[bs_i], &bs_sectors);
-                /* printf("changing part: sector_num=%" PRId64 ", bs_i=%d, "
-                  "bs_offset=%" PRId64 ", bs_sectors=%" PRId64 "\n",
-                   sector_num, bs_i, bs_offset, bs_sectors); */
-            }
-
-            if (n > bs_offset + bs_sectors - sector_num) {
-                n = bs_offset + bs_sectors - sector_num;
-            }
-
-            if (has_zero_init) {
-                /* If the output image is being created as a copy on write image,
-                   assume that sectors which are unallocated in the input image
-                   are present in both the output's and input's base images (no
-                   need to copy them). */
-                if (out_baseimg) {
-                    if (!bdrv_is_allocated(bs[bs_i], sector_num - bs_offset,
-                                           n, &n1)) {
-                        sector_num += n1;
-                        continue;
-                    }
-                    /* The next 'n1' sectors are allocated in the input image. Copy
-                       only those as they may be followed by unallocated sectors. */
-                    n = n1;
-                }
-            } else {
-                n1 = n;
-            }
-
-            ret = bdrv_read(bs[bs_i], sector_num - bs_offset, buf, n);
-            if (ret < 0) {
-                error_report("error while reading sector %" PRId64 ": %s",
-                             sector_num - bs_offset, strerror(-ret));
-                goto out;
-            }
-            /* NOTE: at the same time we convert, we do not write zero
-               sectors to have a chance to compress the image. Ideally, we
-               should add a specific call to have the info to go faster */
-            buf1 = buf;
-            while (n > 0) {
-                /* If the output image is being created as a copy on write image,
-                   copy all sectors even the ones containing only NUL bytes,
-                   because they may differ from the sectors in the base image.
-
-                   If the output is to a host device, we also write out
-                   sectors that are entirely 0, since whatever data was
-                   already there is garbage, not 0s. */
-                if (!has_zero_init || out_baseimg ||
-                    is_allocated_sectors_min(buf1, n, &n1, min_sparse)) {
-                    ret = bdrv_write(out_bs, sector_num, buf1, n1);
-                    if (ret < 0) {
-                        error_report("error while writing sector %" PRId64
-                                     ": %s", sector_num, strerror(-ret));
-                        goto out;
-                    }
-                }
-                sector_num += n1;
-                n -= n1;
-                buf1 += n1 * 512;
-            }
-            qemu_progress_print(local_progress, 100);
-        }
+        ImgConvertState state = {
+            .src                = bs,
+            .src_sectors        = bs_sectors_tab,
+            .src_num            = bs_n,
+            .total_sectors      = total_sectors,
+            .target             = out_bs,
+            .has_zero_init      = bdrv_has_zero_init(out_bs),
+            .target_has_backing = out_baseimg != NULL,
+            .wr_in_order        = wr_in_order,
+            .min_sparse         = min_sparse,
+            .buf_sectors        = IO_BUF_SIZE / BDRV_SECTOR_SIZE,
+            .num_coroutines     = num_coroutines,
+        };
+
+        ret = convert_do_copy(&state);
     }
 out:
     qemu_progress_end();
@@ -1039,6 +1334,7 @@ out:
         }
         g_free(bs);
     }
+    g_free(bs_sectors_tab);
     if (ret) {
         return 1;
     }
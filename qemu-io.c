@@ -1558,7 +1558,7 @@ out:
 
 static int alloc_f(int argc, char **argv)
 {
-    int64_t offset;
+    int64_t offset, sector_num;
     int nb_sectors, remaining;
     char s1[64];
     int num, sum_alloc;
@@ -1579,8 +1579,14 @@ static int alloc_f(int argc, char **argv)
 
     remaining = nb_sectors;
     sum_alloc = 0;
+    sector_num = offset >> 9;
     while (remaining) {
-        ret = bdrv_is_allocated(bs, offset >> 9, nb_sectors, &num);
+        ret = bdrv_is_allocated(bs, sector_num, remaining, &num);
+        if (num == 0) {
+            /* end of the image */
+            break;
+        }
+        sector_num += num;
         remaining -= num;
         if (ret) {
             sum_alloc += num;
@@ -1655,6 +1661,45 @@ static const cmdinfo_t close_cmd = {
     .oneline    = "close the current open file",
 };
 
+static void sigraise_help(void)
+{
+    printf(
+"\n"
+" raises the given signal\n"
+"\n"
+" Example:\n"
+" 'sigraise 9' - kills qemu-io without closing the image\n"
+"\n"
+" Used by the qemu-iotests to leave an image behind in the state it would\n"
+" have after a crash.  Output is flushed before the signal is raised.\n"
+"\n");
+}
+
+static int sigraise_f(int argc, char **argv)
+{
+    int sig = cvtnum(argv[1]);
+
+    if (sig < 0) {
+        printf("non-numeric signal number argument -- %s\n", argv[1]);
+        return 0;
+    }
+
+    fflush(stdout);
+    raise(sig);
+    return 0;
+}
+
+static const cmdinfo_t sigraise_cmd = {
+    .name       = "sigraise",
+    .cfunc      = sigraise_f,
+    .argmin     = 1,
+    .argmax     = 1,
+    .flags      = CMD_NOFILE_OK,
+    .args       = "signal",
+    .oneline    = "raises a signal",
+    .help       = sigraise_help,
+};
+
 static int openfile(char *name, int flags, int growable)
 {
     if (bs) {
@@ -1861,6 +1906,7 @@ int main(int argc, char **argv)
     help_init();
     add_command(&open_cmd);
     add_command(&close_cmd);
+    add_command(&sigraise_cmd);
     add_command(&read_cmd);
     add_command(&readv_cmd);
     add_command(&write_cmd);
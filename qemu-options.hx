@@ -143,6 +143,8 @@ DEF("drive", HAS_ARG, QEMU_OPTION_drive,
     "       [,serial=s][,addr=A][,id=name][,aio=threads|native]\n"
     "       [,readonly=on|off][,copy-on-read=on|off]\n"
     "       [[,bps=b]|[[,bps_rd=r][,bps_wr=w]]][[,iops=i]|[[,iops_rd=r][,iops_wr=w]]\n"
+    "       [,l2-cache-size=size][,refcount-cache-size=size]\n"
+    "       [,cache-clean-interval=seconds]\n"
     "                use 'file' as a drive image\n", QEMU_ARCH_ALL)
 STEXI
 @item -drive @var{option}[,@var{option}[,@var{option}[,...]]]
@@ -196,6 +198,15 @@ Open drive @option{file} as read-only. Guest write attempts will fail.
 @item copy-on-read=@var{copy-on-read}
 @var{copy-on-read} is "on" or "off" and enables whether to copy read backing
 file sectors into the image file.
+@item l2-cache-size=@var{size},refcount-cache-size=@var{size}
+Set the size of the L2 table and refcount block caches of a qcow2 image.
+By default the L2 cache grows with the image until it covers all of it or
+reaches 8 MB, and the refcount cache is a quarter of the L2 cache.
+Each cache may hold at most 4096 tables (one cluster each) and 256 MB.
+@item cache-clean-interval=@var{seconds}
+Write dirty qcow2 metadata cache entries back to the image every
+@var{seconds} seconds instead of only when they are evicted or the drive is
+flushed.  Only useful with @option{cache=writeback} or @option{cache=unsafe}.
 @end table
 
 By default, writethrough caching is used for all block device.  This means that
@@ -2580,6 +2591,47 @@ STEXI
 Set TB size.
 ETEXI
 
+DEF("tb-jmp-cache-bits", HAS_ARG, QEMU_OPTION_tb_jmp_cache_bits, \
+    "-tb-jmp-cache-bits n\n" \
+    "                use 2^n entries per CPU for the virtual PC to TB\n" \
+    "                jump cache (8..20, default 12)\n", QEMU_ARCH_ALL)
+STEXI
+@item -tb-jmp-cache-bits @var{n}
+@findex -tb-jmp-cache-bits
+Use 2^@var{n} entries per CPU for the cache that maps a virtual PC to its
+translated block.  Guests with a large code footprint may run faster with
+a bigger cache; @code{info jit} shows how often it misses.
+ETEXI
+
+DEF("jit-profile", HAS_ARG, QEMU_OPTION_jit_profile, \
+    "-jit-profile [file=f][,hz=n][,hot=n]\n" \
+    "                sample translated code n times per second (default\n" \
+    "                1000), optionally retranslating blocks hit by n samples\n" \
+    "                with full optimization\n", QEMU_ARCH_ALL)
+STEXI
+@item -jit-profile [file=@var{file}][,hz=@var{n}][,hot=@var{n}]
+@findex -jit-profile
+Sample the host PC @var{n} times per second of CPU time (default 1000) and
+charge each sample to the translated block it hit.  @code{info jit-profile}
+shows the blocks where most time is spent; with @option{file} the whole
+profile is also written to @var{file} when QEMU exits.  With
+@option{hot=@var{n}}, blocks are first translated without the TCG
+optimizer and retranslated with it once they have collected @var{n}
+samples.
+ETEXI
+
+DEF("perfmap", 0, QEMU_OPTION_perfmap, \
+    "-perfmap        describe translated code in /tmp/perf-<pid>.map\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -perfmap
+@findex -perfmap
+Write the host address and size of each translated block to
+@file{/tmp/perf-<pid>.map}, where Linux @command{perf} looks for symbols of
+JIT generated code.  Each block is named after its guest PC and, if the
+guest image has a symbol table, the guest function containing it.
+ETEXI
+
 DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming p     prepare for incoming migration, listen on port p\n",
     QEMU_ARCH_ALL)
@@ -1239,6 +1239,14 @@ Each json-object contain the following:
     - "flush_total_time_ns": total time spend on cache flushes in nano-seconds (json-int)
     - "wr_highest_offset": Highest offset of a sector written since the
                            BlockDriverState has been opened (json-int)
+    - "metadata_caches": A json-array of the image format's metadata caches,
+                         omitted if the format has none.  Each element
+                         contains (json-array, optional):
+        - "name": cache name, e.g. "l2" or "refcount" (json-string)
+        - "size": cache size in bytes (json-int)
+        - "hits": lookups served from the cache (json-int)
+        - "misses": lookups that loaded a table (json-int)
+        - "writebacks": dirty tables written to the image (json-int)
 - "parent": Contains recursively the statistics of the underlying
             protocol (e.g. the host file for a qcow2 image). If there is
             no underlying protocol, this field is omitted
@@ -18,6 +18,23 @@ void REGPARM __stl_mmu(target_ulong addr, uint32_t val, int mmu_idx);
 uint64_t REGPARM __ldq_mmu(target_ulong addr, int mmu_idx);
 void REGPARM __stq_mmu(target_ulong addr, uint64_t val, int mmu_idx);
 
+uint8_t REGPARM __cmpxchgb_mmu(target_ulong addr, uint8_t cmpv,
+                               uint8_t newv, int mmu_idx);
+uint16_t REGPARM __cmpxchgw_mmu(target_ulong addr, uint16_t cmpv,
+                                uint16_t newv, int mmu_idx);
+uint32_t REGPARM __cmpxchgl_mmu(target_ulong addr, uint32_t cmpv,
+                                uint32_t newv, int mmu_idx);
+uint64_t REGPARM __cmpxchgq_mmu(target_ulong addr, uint64_t cmpv,
+                                uint64_t newv, int mmu_idx);
+uint8_t REGPARM __xaddb_mmu(target_ulong addr, uint8_t val, int mmu_idx);
+uint16_t REGPARM __xaddw_mmu(target_ulong addr, uint16_t val, int mmu_idx);
+uint32_t REGPARM __xaddl_mmu(target_ulong addr, uint32_t val, int mmu_idx);
+uint64_t REGPARM __xaddq_mmu(target_ulong addr, uint64_t val, int mmu_idx);
+uint8_t REGPARM __xchgb_mmu(target_ulong addr, uint8_t val, int mmu_idx);
+uint16_t REGPARM __xchgw_mmu(target_ulong addr, uint16_t val, int mmu_idx);
+uint32_t REGPARM __xchgl_mmu(target_ulong addr, uint32_t val, int mmu_idx);
+uint64_t REGPARM __xchgq_mmu(target_ulong addr, uint64_t val, int mmu_idx);
+
 uint8_t REGPARM __ldb_cmmu(target_ulong addr, int mmu_idx);
 void REGPARM __stb_cmmu(target_ulong addr, uint8_t val, int mmu_idx);
 uint16_t REGPARM __ldw_cmmu(target_ulong addr, int mmu_idx);
@@ -139,7 +139,9 @@ DATA_TYPE REGPARM glue(glue(__ld, SUFFIX), MMUSUFFIX)(target_ulong addr,
         if ((addr & (DATA_SIZE - 1)) != 0)
             do_unaligned_access(addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
 #endif
-        tlb_fill(env, addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
+        if (!tlb_victim_hit(env, addr, mmu_idx, index, READ_ACCESS_TYPE)) {
+            tlb_fill(env, addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
+        }
         goto redo;
     }
     return res;
@@ -189,7 +191,9 @@ static DATA_TYPE glue(glue(slow_ld, SUFFIX), MMUSUFFIX)(target_ulong addr,
         }
     } else {
         /* the page is not in the TLB : fill it */
-        tlb_fill(env, addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
+        if (!tlb_victim_hit(env, addr, mmu_idx, index, READ_ACCESS_TYPE)) {
+            tlb_fill(env, addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
+        }
         goto redo;
     }
     return res;
@@ -279,7 +283,9 @@ void REGPARM glue(glue(__st, SUFFIX), MMUSUFFIX)(target_ulong addr,
         if ((addr & (DATA_SIZE - 1)) != 0)
             do_unaligned_access(addr, 1, mmu_idx, retaddr);
 #endif
-        tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        if (!tlb_victim_hit(env, addr, mmu_idx, index, 1)) {
+            tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        }
         goto redo;
     }
 }
@@ -326,11 +332,55 @@ static void glue(glue(slow_st, SUFFIX), MMUSUFFIX)(target_ulong addr,
         }
     } else {
         /* the page is not in the TLB : fill it */
-        tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        if (!tlb_victim_hit(env, addr, mmu_idx, index, 1)) {
+            tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        }
         goto redo;
     }
 }
 
+/* Slow paths of the atomic TCG ops, taken on a TLB miss or for IO and
+   unaligned accesses.  All vCPUs run under the global mutex, so the load
+   and the store cannot be separated by another guest access.  */
+DATA_TYPE REGPARM glue(glue(__cmpxchg, SUFFIX), MMUSUFFIX)(target_ulong addr,
+                                                           DATA_TYPE cmpv,
+                                                           DATA_TYPE newv,
+                                                           int mmu_idx)
+{
+    void *retaddr = GETPC();
+    DATA_TYPE res;
+
+    res = glue(glue(slow_ld, SUFFIX), MMUSUFFIX)(addr, mmu_idx, retaddr);
+    if (res == cmpv) {
+        glue(glue(slow_st, SUFFIX), MMUSUFFIX)(addr, newv, mmu_idx, retaddr);
+    }
+    return res;
+}
+
+DATA_TYPE REGPARM glue(glue(__xadd, SUFFIX), MMUSUFFIX)(target_ulong addr,
+                                                        DATA_TYPE val,
+                                                        int mmu_idx)
+{
+    void *retaddr = GETPC();
+    DATA_TYPE res;
+
+    res = glue(glue(slow_ld, SUFFIX), MMUSUFFIX)(addr, mmu_idx, retaddr);
+    glue(glue(slow_st, SUFFIX), MMUSUFFIX)(addr, res + val, mmu_idx, retaddr);
+    return res;
+}
+
+DATA_TYPE REGPARM glue(glue(__xchg, SUFFIX), MMUSUFFIX)(target_ulong addr,
+                                                        DATA_TYPE val,
+                                                        int mmu_idx)
+{
+    void *retaddr = GETPC();
+    DATA_TYPE res;
+
+    res = glue(glue(slow_ld, SUFFIX), MMUSUFFIX)(addr, mmu_idx, retaddr);
+    glue(glue(slow_st, SUFFIX), MMUSUFFIX)(addr, val, mmu_idx, retaddr);
+    return res;
+}
+
 #endif /* !defined(SOFTMMU_CODE_ACCESS) */
 
 #undef READ_ACCESS_TYPE
@@ -66,6 +66,9 @@ typedef uint32_t ARMReadCPFunc(void *opaque, int cp_info,
 
 struct arm_boot_info;
 
+/* Condexec bits of each instruction, for restore_state_to_opc */
+#define TARGET_INSN_EXTRA_WORDS 1
+
 #define NB_MMU_MODES 2
 
 /* We currently assume float and double are IEEE single and double
@@ -573,6 +573,11 @@ void cpsr_write(CPUARMState *env, uint32_t val, uint32_t mask)
     env->uncached_cpsr = (env->uncached_cpsr & ~mask) | (val & mask);
 }
 
+void *HELPER(lookup_tb_ptr)(CPUState *env)
+{
+    return tb_lookup_ptr(env);
+}
+
 /* Sign/zero extend */
 uint32_t HELPER(sxtb16)(uint32_t x)
 {
@@ -731,10 +731,12 @@ static inline void gen_bx_im(DisasContext *s, uint32_t addr)
     tcg_gen_movi_i32(cpu_R[15], addr & ~1);
 }
 
-/* Set PC and Thumb state from var.  var is marked as dead.  */
+/* Set PC and Thumb state from var.  var is marked as dead.  The Thumb
+   bit is part of the TB flags, so the next TB can still be looked up
+   from the generated code.  */
 static inline void gen_bx(DisasContext *s, TCGv var)
 {
-    s->is_jmp = DISAS_UPDATE;
+    s->is_jmp = DISAS_JUMP;
     tcg_gen_andi_i32(cpu_R[15], var, ~1);
     tcg_gen_andi_i32(var, var, 1);
     store_cpu_field(var, thumb);
@@ -6617,10 +6619,57 @@ static void gen_clrex(DisasContext *s)
     tcg_gen_movi_i32(cpu_exclusive_addr, -1);
 }
 
+#if TCG_TARGET_HAS_qemu_atomic
+/* Implement a byte, halfword or word store exclusive as a host
+   compare-and-swap against the value seen by the load exclusive.  Unlike
+   the generic versions below this neither stops the other CPUs nor
+   needs them to be serialized, but (like any LL/SC emulation built on
+   cmpxchg) it cannot notice that the location was changed and then
+   restored in between.  */
+static void gen_store_exclusive_atomic(DisasContext *s, int rd, int rt,
+                                       TCGv addr, int size)
+{
+    TCGv tmp;
+    TCGv addr_local;
+    int done_label;
+    int fail_label;
+
+    /* if (env->exclusive_addr == addr) {
+         {Rd} = cmpxchg([addr], env->exclusive_val, {Rt})
+                != env->exclusive_val;
+       } else {
+         {Rd} = 1;
+       } */
+    fail_label = gen_new_label();
+    done_label = gen_new_label();
+    addr_local = tcg_temp_local_new_i32();
+    tcg_gen_mov_i32(addr_local, addr);
+    tcg_gen_brcond_i32(TCG_COND_NE, addr_local, cpu_exclusive_addr,
+                       fail_label);
+    tmp = tcg_temp_new_i32();
+    tcg_gen_qemu_cmpxchg(tmp, addr_local, cpu_exclusive_val, cpu_R[rt],
+                         IS_USER(s), size);
+    tcg_gen_setcond_i32(TCG_COND_NE, cpu_R[rd], tmp, cpu_exclusive_val);
+    tcg_temp_free_i32(tmp);
+    tcg_gen_br(done_label);
+    gen_set_label(fail_label);
+    tcg_gen_movi_i32(cpu_R[rd], 1);
+    gen_set_label(done_label);
+    tcg_gen_movi_i32(cpu_exclusive_addr, -1);
+    tcg_temp_free_i32(addr_local);
+}
+#endif
+
 #ifdef CONFIG_USER_ONLY
 static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
                                 TCGv addr, int size)
 {
+#if TCG_TARGET_HAS_qemu_atomic
+    if (size != 3) {
+        gen_store_exclusive_atomic(s, rd, rt, addr, size);
+        return;
+    }
+#endif
     tcg_gen_mov_i32(cpu_exclusive_test, addr);
     tcg_gen_movi_i32(cpu_exclusive_info,
                      size | (rd << 4) | (rt << 8) | (rt2 << 12));
@@ -6634,6 +6683,12 @@ static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
     int done_label;
     int fail_label;
 
+#if TCG_TARGET_HAS_qemu_atomic
+    if (size != 3) {
+        gen_store_exclusive_atomic(s, rd, rt, addr, size);
+        return;
+    }
+#endif
     /* if (env->exclusive_addr == addr && env->exclusive_val == [addr]) {
          [addr] = {Rt};
          {Rd} = 0;
@@ -7417,11 +7472,17 @@ static void disas_arm_insn(CPUState * env, DisasContext *s)
                         /* SWP instruction */
                         rm = (insn) & 0xf;
 
+                        addr = load_reg(s, rn);
+                        tmp = load_reg(s, rm);
+#if TCG_TARGET_HAS_qemu_atomic
+                        tmp2 = tcg_temp_new_i32();
+                        tcg_gen_qemu_xchg(tmp2, addr, tmp, IS_USER(s),
+                                          (insn & (1 << 22)) ? 0 : 2);
+                        tcg_temp_free_i32(tmp);
+#else
                         /* ??? This is not really atomic.  However we know
                            we never have multiple CPUs running in parallel,
                            so it is good enough.  */
-                        addr = load_reg(s, rn);
-                        tmp = load_reg(s, rm);
                         if (insn & (1 << 22)) {
                             tmp2 = gen_ld8u(addr, IS_USER(s));
                             gen_st8(tmp, addr, IS_USER(s));
@@ -7429,6 +7490,7 @@ static void disas_arm_insn(CPUState * env, DisasContext *s)
                             tmp2 = gen_ld32(addr, IS_USER(s));
                             gen_st32(tmp, addr, IS_USER(s));
                         }
+#endif
                         tcg_temp_free_i32(addr);
                         store_reg(s, rd, tmp2);
                     }
@@ -10056,8 +10118,16 @@ static inline void gen_intermediate_code_internal(CPUState *env,
         case DISAS_NEXT:
             gen_goto_tb(dc, 1, dc->pc);
             break;
-        default:
         case DISAS_JUMP:
+            /* indirect branch: look up the next TB from the jump cache */
+            {
+                TCGv_ptr ptr = tcg_temp_new_ptr();
+                gen_helper_lookup_tb_ptr(ptr, cpu_env);
+                tcg_gen_jmp_ptr(ptr);
+                tcg_temp_free_ptr(ptr);
+            }
+            break;
+        default:
         case DISAS_UPDATE:
             /* indicate that the hash table must be used to find the next TB */
             tcg_gen_exit_tb(0);
@@ -10097,10 +10167,9 @@ done_generating:
         lj++;
         while (lj <= j)
             gen_opc_instr_start[lj++] = 0;
-    } else {
-        tb->size = dc->pc - pc_start;
-        tb->icount = num_insns;
     }
+    tb->size = dc->pc - pc_start;
+    tb->icount = num_insns;
 }
 
 void gen_intermediate_code(CPUState *env, TranslationBlock *tb)
@@ -10170,6 +10239,16 @@ void cpu_dump_state(CPUState *env, FILE *f, fprintf_function cpu_fprintf,
 #endif
 }
 
+void save_opc_extra(target_ulong *extra, int pc_pos)
+{
+    extra[0] = gen_opc_condexec_bits[pc_pos];
+}
+
+void load_opc_extra(const target_ulong *extra, int pc_pos)
+{
+    gen_opc_condexec_bits[pc_pos] = extra[0];
+}
+
 void restore_state_to_opc(CPUState *env, TranslationBlock *tb, int pc_pos)
 {
     env->regs[15] = gen_opc_pc[pc_pos];
@@ -3409,10 +3409,9 @@ gen_intermediate_code_internal(CPUState *env, TranslationBlock *tb,
 		lj++;
 		while (lj <= j)
 			gen_opc_instr_start[lj++] = 0;
-	} else {
-		tb->size = dc->pc - pc_start;
-                tb->icount = num_insns;
 	}
+	tb->size = dc->pc - pc_start;
+	tb->icount = num_insns;
 
 #ifdef DEBUG_DISAS
 #if !DISAS_CRIS
@@ -611,6 +611,9 @@ typedef struct {
 #define CPU_NB_REGS CPU_NB_REGS32
 #endif
 
+/* CC_OP of each instruction, for restore_state_to_opc */
+#define TARGET_INSN_EXTRA_WORDS 1
+
 #define NB_MMU_MODES 2
 
 typedef struct CPUX86State {
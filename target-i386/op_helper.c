@@ -31,6 +31,13 @@
 #include "softmmu_exec.h"
 #endif /* !defined(CONFIG_USER_ONLY) */
 
+/* SSE2 is architectural on x86_64 hosts and enabled by -msse2 on i386
+   ones; when present the XMM byte and word helpers use it directly. */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_HOST_SSE2
+#endif
+
 //#define DEBUG_PCALL
 
 #ifdef DEBUG_PCALL
@@ -4913,6 +4920,11 @@ void helper_reset_rf(void)
     env->eflags &= ~RF_MASK;
 }
 
+void *helper_lookup_tb_ptr(void)
+{
+    return tb_lookup_ptr(env);
+}
+
 void helper_raise_interrupt(int intno, int next_eip_addend)
 {
     raise_interrupt(intno, 1, 0, next_eip_addend);
@@ -283,6 +283,28 @@ void glue(name, SUFFIX) (Reg *d, Reg *s)\
     )\
 }
 
+#if SHIFT == 1 && defined(USE_HOST_SSE2)
+/* The XMMReg layout is the host one on x86 hosts, so the byte ops and
+   the saturating, compare, min/max and average ops on words are done
+   with one host instruction instead of 8 or 16 element operations.  Everything
+   else stays in C: TCG has just stored the registers as two 64-bit
+   halves, and reloading them as one 128-bit value costs more than the
+   few 64-bit or word operations the compiler makes of the C code.  */
+#define SSE_HELPER_HOST(name, V)\
+void glue(name, SUFFIX) (Reg *d, Reg *s)\
+{\
+    __m128i a = _mm_loadu_si128((__m128i *)d);\
+    __m128i b = _mm_loadu_si128((__m128i *)s);\
+    _mm_storeu_si128((__m128i *)d, V(a, b));\
+}
+
+#define SSE_HELPER_BV(name, F, V) SSE_HELPER_HOST(name, V)
+#define SSE_HELPER_WV(name, F, V) SSE_HELPER_HOST(name, V)
+#else
+#define SSE_HELPER_BV(name, F, V) SSE_HELPER_B(name, F)
+#define SSE_HELPER_WV(name, F, V) SSE_HELPER_W(name, F)
+#endif
+
 #if SHIFT == 0
 static inline int satub(int x)
 {
@@ -358,43 +380,43 @@ static inline int satsw(int x)
 #define FAVG(a, b) ((a) + (b) + 1) >> 1
 #endif
 
-SSE_HELPER_B(helper_paddb, FADD)
+SSE_HELPER_BV(helper_paddb, FADD, _mm_add_epi8)
 SSE_HELPER_W(helper_paddw, FADD)
 SSE_HELPER_L(helper_paddl, FADD)
 SSE_HELPER_Q(helper_paddq, FADD)
 
-SSE_HELPER_B(helper_psubb, FSUB)
+SSE_HELPER_BV(helper_psubb, FSUB, _mm_sub_epi8)
 SSE_HELPER_W(helper_psubw, FSUB)
 SSE_HELPER_L(helper_psubl, FSUB)
 SSE_HELPER_Q(helper_psubq, FSUB)
 
-SSE_HELPER_B(helper_paddusb, FADDUB)
-SSE_HELPER_B(helper_paddsb, FADDSB)
-SSE_HELPER_B(helper_psubusb, FSUBUB)
-SSE_HELPER_B(helper_psubsb, FSUBSB)
+SSE_HELPER_BV(helper_paddusb, FADDUB, _mm_adds_epu8)
+SSE_HELPER_BV(helper_paddsb, FADDSB, _mm_adds_epi8)
+SSE_HELPER_BV(helper_psubusb, FSUBUB, _mm_subs_epu8)
+SSE_HELPER_BV(helper_psubsb, FSUBSB, _mm_subs_epi8)
 
-SSE_HELPER_W(helper_paddusw, FADDUW)
-SSE_HELPER_W(helper_paddsw, FADDSW)
-SSE_HELPER_W(helper_psubusw, FSUBUW)
-SSE_HELPER_W(helper_psubsw, FSUBSW)
+SSE_HELPER_WV(helper_paddusw, FADDUW, _mm_adds_epu16)
+SSE_HELPER_WV(helper_paddsw, FADDSW, _mm_adds_epi16)
+SSE_HELPER_WV(helper_psubusw, FSUBUW, _mm_subs_epu16)
+SSE_HELPER_WV(helper_psubsw, FSUBSW, _mm_subs_epi16)
 
-SSE_HELPER_B(helper_pminub, FMINUB)
-SSE_HELPER_B(helper_pmaxub, FMAXUB)
+SSE_HELPER_BV(helper_pminub, FMINUB, _mm_min_epu8)
+SSE_HELPER_BV(helper_pmaxub, FMAXUB, _mm_max_epu8)
 
-SSE_HELPER_W(helper_pminsw, FMINSW)
-SSE_HELPER_W(helper_pmaxsw, FMAXSW)
+SSE_HELPER_WV(helper_pminsw, FMINSW, _mm_min_epi16)
+SSE_HELPER_WV(helper_pmaxsw, FMAXSW, _mm_max_epi16)
 
 SSE_HELPER_Q(helper_pand, FAND)
 SSE_HELPER_Q(helper_pandn, FANDN)
 SSE_HELPER_Q(helper_por, FOR)
 SSE_HELPER_Q(helper_pxor, FXOR)
 
-SSE_HELPER_B(helper_pcmpgtb, FCMPGTB)
-SSE_HELPER_W(helper_pcmpgtw, FCMPGTW)
+SSE_HELPER_BV(helper_pcmpgtb, FCMPGTB, _mm_cmpgt_epi8)
+SSE_HELPER_WV(helper_pcmpgtw, FCMPGTW, _mm_cmpgt_epi16)
 SSE_HELPER_L(helper_pcmpgtl, FCMPGTL)
 
-SSE_HELPER_B(helper_pcmpeqb, FCMPEQ)
-SSE_HELPER_W(helper_pcmpeqw, FCMPEQ)
+SSE_HELPER_BV(helper_pcmpeqb, FCMPEQ, _mm_cmpeq_epi8)
+SSE_HELPER_WV(helper_pcmpeqw, FCMPEQ, _mm_cmpeq_epi16)
 SSE_HELPER_L(helper_pcmpeql, FCMPEQ)
 
 SSE_HELPER_W(helper_pmullw, FMULLW)
@@ -404,8 +426,8 @@ SSE_HELPER_W(helper_pmulhrw, FMULHRW)
 SSE_HELPER_W(helper_pmulhuw, FMULHUW)
 SSE_HELPER_W(helper_pmulhw, FMULHW)
 
-SSE_HELPER_B(helper_pavgb, FAVG)
-SSE_HELPER_W(helper_pavgw, FAVG)
+SSE_HELPER_BV(helper_pavgb, FAVG, _mm_avg_epu8)
+SSE_HELPER_WV(helper_pavgw, FAVG, _mm_avg_epu16)
 
 void glue(helper_pmuludq, SUFFIX) (Reg *d, Reg *s)
 {
@@ -434,6 +456,9 @@ static inline int abs1(int a)
         return a;
 }
 #endif
+#if SHIFT == 1 && defined(USE_HOST_SSE2)
+SSE_HELPER_HOST(helper_psadbw, _mm_sad_epu8)
+#else
 void glue(helper_psadbw, SUFFIX) (Reg *d, Reg *s)
 {
     unsigned int val;
@@ -461,6 +486,7 @@ void glue(helper_psadbw, SUFFIX) (Reg *d, Reg *s)
     d->Q(1) = val;
 #endif
 }
+#endif
 
 void glue(helper_maskmov, SUFFIX) (Reg *d, Reg *s, target_ulong a0)
 {
@@ -2087,6 +2113,8 @@ target_ulong helper_popcnt(target_ulong n, uint32_t type)
 #endif
 
 #undef SHIFT
+#undef SSE_HELPER_BV
+#undef SSE_HELPER_WV
 #undef XMM_ONLY
 #undef Reg
 #undef B
@@ -1122,10 +1122,9 @@ static void gen_intermediate_code_internal(CPUState *env,
         while (lj <= j) {
             gen_opc_instr_start[lj++] = 0;
         }
-    } else {
-        tb->size = dc->pc - pc_start;
-        tb->icount = num_insns;
     }
+    tb->size = dc->pc - pc_start;
+    tb->icount = num_insns;
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)) {
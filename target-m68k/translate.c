@@ -3069,10 +3069,9 @@ gen_intermediate_code_internal(CPUState *env, TranslationBlock *tb,
         lj++;
         while (lj <= j)
             gen_opc_instr_start[lj++] = 0;
-    } else {
-        tb->size = dc->pc - pc_start;
-        tb->icount = num_insns;
     }
+    tb->size = dc->pc - pc_start;
+    tb->icount = num_insns;
 
     //optimize_flags();
     //expand_target_qops();
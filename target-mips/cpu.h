@@ -109,6 +109,9 @@ struct CPUMIPSFPUContext {
 #define FP_UNIMPLEMENTED  32
 };
 
+/* Branch hflags of each instruction, for restore_state_to_opc */
+#define TARGET_INSN_EXTRA_WORDS 1
+
 #define NB_MMU_MODES 3
 
 typedef struct CPUMIPSMVPContext CPUMIPSMVPContext;
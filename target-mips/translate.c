@@ -12515,10 +12515,9 @@ done_generating:
         lj++;
         while (lj <= j)
             gen_opc_instr_start[lj++] = 0;
-    } else {
-        tb->size = ctx.pc - pc_start;
-        tb->icount = num_insns;
     }
+    tb->size = ctx.pc - pc_start;
+    tb->icount = num_insns;
 #ifdef DEBUG_DISAS
     LOG_DISAS("\n");
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)) {
@@ -12848,6 +12847,16 @@ void cpu_reset (CPUMIPSState *env)
     env->exception_index = EXCP_NONE;
 }
 
+void save_opc_extra(target_ulong *extra, int pc_pos)
+{
+    extra[0] = gen_opc_hflags[pc_pos];
+}
+
+void load_opc_extra(const target_ulong *extra, int pc_pos)
+{
+    gen_opc_hflags[pc_pos] = extra[0];
+}
+
 void restore_state_to_opc(CPUState *env, TranslationBlock *tb, int pc_pos)
 {
     env->active_tc.PC = gen_opc_pc[pc_pos];
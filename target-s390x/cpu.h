@@ -35,6 +35,9 @@
 
 #include "softfloat.h"
 
+/* CC_OP of each instruction, for restore_state_to_opc */
+#define TARGET_INSN_EXTRA_WORDS 1
+
 #define NB_MMU_MODES 3
 
 #define MMU_MODE0_SUFFIX _primary
@@ -5214,10 +5214,9 @@ static inline void gen_intermediate_code_internal(CPUState *env,
         while (lj <= j) {
             gen_opc_instr_start[lj++] = 0;
         }
-    } else {
-        tb->size = dc.pc - pc_start;
-        tb->icount = num_insns;
     }
+    tb->size = dc.pc - pc_start;
+    tb->icount = num_insns;
 #if defined(S390X_DEBUG_DISAS)
     log_cpu_state_mask(CPU_LOG_TB_CPU, env, 0);
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)) {
@@ -5238,6 +5237,16 @@ void gen_intermediate_code_pc (CPUState *env, struct TranslationBlock *tb)
     gen_intermediate_code_internal(env, tb, 1);
 }
 
+void save_opc_extra(target_ulong *extra, int pc_pos)
+{
+    extra[0] = gen_opc_cc_op[pc_pos];
+}
+
+void load_opc_extra(const target_ulong *extra, int pc_pos)
+{
+    gen_opc_cc_op[pc_pos] = extra[0];
+}
+
 void restore_state_to_opc(CPUState *env, TranslationBlock *tb, int pc_pos)
 {
     int cc_op;
@@ -122,6 +122,9 @@ typedef struct tlb_t {
 #define UTLB_SIZE 64
 #define ITLB_SIZE 4
 
+/* Flags of each instruction, for restore_state_to_opc */
+#define TARGET_INSN_EXTRA_WORDS 1
+
 #define NB_MMU_MODES 2
 
 enum sh_features {
@@ -2033,10 +2033,9 @@ gen_intermediate_code_internal(CPUState * env, TranslationBlock * tb,
         ii++;
         while (ii <= i)
             gen_opc_instr_start[ii++] = 0;
-    } else {
-        tb->size = ctx.pc - pc_start;
-        tb->icount = num_insns;
     }
+    tb->size = ctx.pc - pc_start;
+    tb->icount = num_insns;
 
 #ifdef DEBUG_DISAS
 #ifdef SH4_DEBUG_DISAS
@@ -2060,6 +2059,16 @@ void gen_intermediate_code_pc(CPUState * env, struct TranslationBlock *tb)
     gen_intermediate_code_internal(env, tb, 1);
 }
 
+void save_opc_extra(target_ulong *extra, int pc_pos)
+{
+    extra[0] = gen_opc_hflags[pc_pos];
+}
+
+void load_opc_extra(const target_ulong *extra, int pc_pos)
+{
+    gen_opc_hflags[pc_pos] = extra[0];
+}
+
 void restore_state_to_opc(CPUState *env, TranslationBlock *tb, int pc_pos)
 {
     env->pc = gen_opc_pc[pc_pos];
@@ -225,6 +225,9 @@ enum {
 #define MIN_NWINDOWS 3
 #define MAX_NWINDOWS 32
 
+/* NPC and jump targets of each instruction, for restore_state_to_opc */
+#define TARGET_INSN_EXTRA_WORDS 3
+
 #if !defined(TARGET_SPARC64)
 #define NB_MMU_MODES 2
 #else
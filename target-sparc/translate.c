@@ -5352,10 +5352,9 @@ static inline void gen_intermediate_code_internal(TranslationBlock * tb,
 #endif
         gen_opc_jump_pc[0] = dc->jump_pc[0];
         gen_opc_jump_pc[1] = dc->jump_pc[1];
-    } else {
-        tb->size = last_pc + 4 - pc_start;
-        tb->icount = num_insns;
     }
+    tb->size = last_pc + 4 - pc_start;
+    tb->icount = num_insns;
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)) {
         qemu_log("--------------\n");
@@ -5482,6 +5481,20 @@ void gen_intermediate_code_init(CPUSPARCState *env)
     }
 }
 
+void save_opc_extra(target_ulong *extra, int pc_pos)
+{
+    extra[0] = gen_opc_npc[pc_pos];
+    extra[1] = gen_opc_jump_pc[0];
+    extra[2] = gen_opc_jump_pc[1];
+}
+
+void load_opc_extra(const target_ulong *extra, int pc_pos)
+{
+    gen_opc_npc[pc_pos] = extra[0];
+    gen_opc_jump_pc[0] = extra[1];
+    gen_opc_jump_pc[1] = extra[2];
+}
+
 void restore_state_to_opc(CPUState *env, TranslationBlock *tb, int pc_pos)
 {
     target_ulong npc;
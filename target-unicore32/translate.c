@@ -2024,10 +2024,9 @@ done_generating:
         while (lj <= j) {
             gen_opc_instr_start[lj++] = 0;
         }
-    } else {
-        tb->size = dc->pc - pc_start;
-        tb->icount = num_insns;
     }
+    tb->size = dc->pc - pc_start;
+    tb->icount = num_insns;
 }
 
 void gen_intermediate_code(CPUState *env, TranslationBlock *tb)
@@ -2492,10 +2492,8 @@ static void gen_intermediate_code_internal(
     gen_icount_end(tb, insn_count);
     *gen_opc_ptr = INDEX_op_end;
 
-    if (!search_pc) {
-        tb->size = dc.pc - pc_start;
-        tb->icount = insn_count;
-    }
+    tb->size = dc.pc - pc_start;
+    tb->icount = insn_count;
 }
 
 void gen_intermediate_code(CPUState *env, TranslationBlock *tb)
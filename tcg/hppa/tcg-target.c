@@ -1283,8 +1283,7 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
         break;
 
     case INDEX_op_jmp:
-        fprintf(stderr, "unimplemented jmp\n");
-        tcg_abort();
+        tcg_out32(s, INSN_BV_N | INSN_R2(args[0]));
         break;
 
     case INDEX_op_br:
@@ -254,6 +254,7 @@ static inline int tcg_target_const_match(tcg_target_long val,
 #define OPC_BSWAP	(0xc8 | P_EXT)
 #define OPC_CALL_Jz	(0xe8)
 #define OPC_CMP_GvEv	(OPC_ARITH_GvEv | (ARITH_CMP << 3))
+#define OPC_CMPXCHG_EvGv (0xb1 | P_EXT)
 #define OPC_DEC_r32	(0x48)
 #define OPC_IMUL_GvEv	(0xaf | P_EXT)
 #define OPC_IMUL_GvEvIb	(0x6b)
@@ -284,7 +285,9 @@ static inline int tcg_target_const_match(tcg_target_long val,
 #define OPC_SHIFT_Ib	(0xc1)
 #define OPC_SHIFT_cl	(0xd3)
 #define OPC_TESTL	(0x85)
+#define OPC_XADD_EvGv	(0xc1 | P_EXT)
 #define OPC_XCHG_ax_r32	(0x90)
+#define OPC_XCHG_EvGv	(0x87)
 
 #define OPC_GRP3_Ev	(0xf7)
 #define OPC_GRP5	(0xff)
@@ -1434,6 +1437,168 @@ static void tcg_out_qemu_st(TCGContext *s, const TCGArg *args,
 #endif
 }
 
+#if TCG_TARGET_HAS_qemu_atomic
+#if defined(CONFIG_SOFTMMU)
+static void *qemu_cmpxchg_helpers[4] = {
+    __cmpxchgb_mmu,
+    __cmpxchgw_mmu,
+    __cmpxchgl_mmu,
+    __cmpxchgq_mmu,
+};
+
+static void *qemu_xadd_helpers[4] = {
+    __xaddb_mmu,
+    __xaddw_mmu,
+    __xaddl_mmu,
+    __xaddq_mmu,
+};
+
+static void *qemu_xchg_helpers[4] = {
+    __xchgb_mmu,
+    __xchgw_mmu,
+    __xchgl_mmu,
+    __xchgq_mmu,
+};
+#endif
+
+/* Emit the locked instruction for OPC on the host memory at BASE+OFS.
+   For cmpxchg the comparison value is in %eax and REG holds the new
+   value; otherwise REG holds the operand and receives the old value.  */
+static void tcg_out_atomic_direct(TCGContext *s, TCGOpcode opc, int reg,
+                                  int base, tcg_target_long ofs, int sizeop)
+{
+    int opcode;
+
+    switch (opc) {
+    case INDEX_op_qemu_cmpxchg:
+        opcode = OPC_CMPXCHG_EvGv;
+        break;
+    case INDEX_op_qemu_xadd:
+        opcode = OPC_XADD_EvGv;
+        break;
+    case INDEX_op_qemu_xchg:
+        opcode = OPC_XCHG_EvGv;
+        break;
+    default:
+        tcg_abort();
+    }
+
+    switch (sizeop) {
+    case 0:
+        /* The byte forms are one less than the word forms.  */
+        opcode = (opcode - 1) | P_REXB_R;
+        break;
+    case 1:
+        opcode |= P_DATA16;
+        break;
+    case 2:
+        break;
+    case 3:
+        opcode |= P_REXW;
+        break;
+    default:
+        tcg_abort();
+    }
+
+    /* xchg with a memory operand is implicitly locked.  */
+    if (opc != INDEX_op_qemu_xchg) {
+        tcg_out8(s, 0xf0);
+    }
+    tcg_out_modrm_offset(s, opcode, reg, base, ofs);
+}
+
+static void tcg_out_qemu_atomic(TCGContext *s, TCGOpcode opc,
+                                const TCGArg *args)
+{
+    int data_reg, reg, addr_idx, s_bits;
+#if defined(CONFIG_SOFTMMU)
+    int mem_index;
+    uint8_t *label_ptr[3];
+    void *helper;
+#endif
+
+    data_reg = args[0];
+    if (opc == INDEX_op_qemu_cmpxchg) {
+        /* args[1], the comparison value, is already in data_reg (%eax).  */
+        reg = args[2];
+        addr_idx = 3;
+    } else {
+        /* args[1], the operand, is already in data_reg.  */
+        reg = data_reg;
+        addr_idx = 2;
+    }
+    s_bits = args[addr_idx + 2];
+
+#if defined(CONFIG_SOFTMMU)
+    mem_index = args[addr_idx + 1];
+
+    /* The TLB entry must allow writes; an unaligned address fails the
+       comparison, so the host instruction is never split.  */
+    tcg_out_tlb_load(s, addr_idx, mem_index, s_bits, args,
+                     label_ptr, offsetof(CPUTLBEntry, addr_write));
+
+    /* TLB Hit.  */
+    tcg_out_atomic_direct(s, opc, reg, tcg_target_call_iarg_regs[0], 0,
+                          s_bits);
+
+    /* jmp label2 */
+    tcg_out8(s, OPC_JMP_short);
+    label_ptr[2] = s->code_ptr;
+    s->code_ptr++;
+
+    /* TLB Miss.  */
+
+    /* label1: */
+    *label_ptr[0] = s->code_ptr - label_ptr[0] - 1;
+
+    /* The first argument is already loaded with the address.  */
+    tcg_out_mov(s, TCG_TYPE_I64, TCG_REG_RSI, data_reg);
+    if (opc == INDEX_op_qemu_cmpxchg) {
+        tcg_out_mov(s, TCG_TYPE_I64, TCG_REG_RDX, reg);
+        tcg_out_movi(s, TCG_TYPE_I32, TCG_REG_RCX, mem_index);
+        helper = qemu_cmpxchg_helpers[s_bits];
+    } else {
+        tcg_out_movi(s, TCG_TYPE_I32, TCG_REG_RDX, mem_index);
+        helper = (opc == INDEX_op_qemu_xadd ? qemu_xadd_helpers[s_bits]
+                  : qemu_xchg_helpers[s_bits]);
+    }
+    tcg_out_calli(s, (tcg_target_long)helper);
+    tcg_out_mov(s, TCG_TYPE_I64, data_reg, TCG_REG_RAX);
+
+    /* label2: */
+    *label_ptr[2] = s->code_ptr - label_ptr[2] - 1;
+#else
+    {
+        int32_t offset = GUEST_BASE;
+        int base = args[addr_idx];
+
+        /* See tcg_out_qemu_ld for the zero extension of the address.  */
+        if (offset != GUEST_BASE) {
+            tcg_out_movi(s, TCG_TYPE_I64, TCG_REG_RDI, GUEST_BASE);
+            tgen_arithr(s, ARITH_ADD + P_REXW, TCG_REG_RDI, base);
+            base = TCG_REG_RDI, offset = 0;
+        }
+
+        tcg_out_atomic_direct(s, opc, reg, base, offset, s_bits);
+    }
+#endif
+
+    /* The helpers and the byte and word forms leave the high bits of
+       data_reg undefined.  */
+    switch (s_bits) {
+    case 0:
+        tcg_out_ext8u(s, data_reg, data_reg);
+        break;
+    case 1:
+        tcg_out_ext16u(s, data_reg, data_reg);
+        break;
+    case 2:
+        tcg_out_ext32u(s, data_reg, data_reg);
+        break;
+    }
+}
+#endif
+
 static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
                               const TCGArg *args, const int *const_args)
 {
@@ -1680,6 +1845,13 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
     case INDEX_op_qemu_st64:
         tcg_out_qemu_st(s, args, 3);
         break;
+#if TCG_TARGET_HAS_qemu_atomic
+    case INDEX_op_qemu_cmpxchg:
+    case INDEX_op_qemu_xadd:
+    case INDEX_op_qemu_xchg:
+        tcg_out_qemu_atomic(s, opc, args);
+        break;
+#endif
 
 #if TCG_TARGET_REG_BITS == 32
     case INDEX_op_brcond2_i32:
@@ -1894,6 +2066,12 @@ static const TCGTargetOpDef x86_op_defs[] = {
     { INDEX_op_qemu_st16, { "L", "L" } },
     { INDEX_op_qemu_st32, { "L", "L" } },
     { INDEX_op_qemu_st64, { "L", "L" } },
+
+#if TCG_TARGET_HAS_qemu_atomic
+    { INDEX_op_qemu_cmpxchg, { "a", "0", "L", "L" } },
+    { INDEX_op_qemu_xadd, { "L", "0", "L" } },
+    { INDEX_op_qemu_xchg, { "L", "0", "L" } },
+#endif
 #elif TARGET_LONG_BITS <= TCG_TARGET_REG_BITS
     { INDEX_op_qemu_ld8u, { "r", "L" } },
     { INDEX_op_qemu_ld8s, { "r", "L" } },
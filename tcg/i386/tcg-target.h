@@ -107,6 +107,13 @@ typedef enum {
 #define TCG_TARGET_HAS_nand_i64         0
 #define TCG_TARGET_HAS_nor_i64          0
 #define TCG_TARGET_HAS_deposit_i64      1
+/* atomic ops are done in place, which requires the guest and host to
+   agree on byte order */
+#ifdef TARGET_WORDS_BIGENDIAN
+#define TCG_TARGET_HAS_qemu_atomic      0
+#else
+#define TCG_TARGET_HAS_qemu_atomic      1
+#endif
 #endif
 
 #define TCG_TARGET_deposit_i32_valid(ofs, len) \
@@ -48,10 +48,141 @@ struct tcg_temp_info {
     uint16_t prev_copy;
     uint16_t next_copy;
     tcg_target_ulong val;
+    tcg_target_ulong mask;  /* bits that may be nonzero */
 };
 
 static struct tcg_temp_info temps[TCG_MAX_TEMPS];
 
+/* Available expressions of the current basic block, used for common
+   subexpression elimination.  'res' holds the value of 'op' applied to
+   'arg1' and 'arg2' until one of the three temps is redefined. */
+#define TCG_OPT_CSE_SIZE 32
+
+struct tcg_cse_entry {
+    TCGOpcode op;
+    TCGArg arg1;
+    TCGArg arg2;
+    TCGArg res;
+};
+
+static struct tcg_cse_entry cse_table[TCG_OPT_CSE_SIZE];
+static int cse_count;
+static int cse_next;
+
+static void reset_all_temps(int nb_temps)
+{
+    int i;
+
+    for (i = 0; i < nb_temps; i++) {
+        temps[i].state = TCG_TEMP_UNDEF;
+        temps[i].mask = -1;
+    }
+    cse_count = 0;
+    cse_next = 0;
+}
+
+/* Forget all expressions which use or produce TEMP. */
+static void cse_invalidate(TCGArg temp)
+{
+    int i;
+
+    for (i = 0; i < cse_count; i++) {
+        if (cse_table[i].res == temp || cse_table[i].arg1 == temp ||
+            cse_table[i].arg2 == temp) {
+            cse_table[i] = cse_table[--cse_count];
+            i--;
+        }
+    }
+    if (cse_next > cse_count) {
+        cse_next = cse_count;
+    }
+}
+
+/* Forget all expressions which involve a global. */
+static void cse_invalidate_globals(int nb_globals)
+{
+    int i;
+
+    for (i = 0; i < cse_count; i++) {
+        if (cse_table[i].res < nb_globals || cse_table[i].arg1 < nb_globals ||
+            (cse_table[i].arg2 != (TCGArg)-1 &&
+             cse_table[i].arg2 < nb_globals)) {
+            cse_table[i] = cse_table[--cse_count];
+            i--;
+        }
+    }
+    if (cse_next > cse_count) {
+        cse_next = cse_count;
+    }
+}
+
+static int cse_lookup(TCGOpcode op, TCGArg arg1, TCGArg arg2)
+{
+    int i;
+
+    for (i = 0; i < cse_count; i++) {
+        if (cse_table[i].op == op && cse_table[i].arg1 == arg1 &&
+            cse_table[i].arg2 == arg2) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void cse_record(TCGOpcode op, TCGArg arg1, TCGArg arg2, TCGArg res)
+{
+    struct tcg_cse_entry *e;
+
+    /* The result must not overwrite one of the operands. */
+    if (res == arg1 || res == arg2) {
+        return;
+    }
+    if (cse_count < TCG_OPT_CSE_SIZE) {
+        e = &cse_table[cse_count++];
+    } else {
+        e = &cse_table[cse_next];
+        cse_next = (cse_next + 1) % TCG_OPT_CSE_SIZE;
+    }
+    e->op = op;
+    e->arg1 = arg1;
+    e->arg2 = arg2;
+    e->res = res;
+}
+
+/* Pure operations whose result only depends on their inputs. */
+static bool op_is_cse_candidate(TCGOpcode op)
+{
+    switch (op) {
+    CASE_OP_32_64(add):
+    CASE_OP_32_64(sub):
+    CASE_OP_32_64(mul):
+    CASE_OP_32_64(and):
+    CASE_OP_32_64(or):
+    CASE_OP_32_64(xor):
+    CASE_OP_32_64(shl):
+    CASE_OP_32_64(shr):
+    CASE_OP_32_64(sar):
+    CASE_OP_32_64(rotl):
+    CASE_OP_32_64(rotr):
+    CASE_OP_32_64(andc):
+    CASE_OP_32_64(orc):
+    CASE_OP_32_64(eqv):
+    CASE_OP_32_64(nand):
+    CASE_OP_32_64(nor):
+    CASE_OP_32_64(not):
+    CASE_OP_32_64(neg):
+    CASE_OP_32_64(ext8s):
+    CASE_OP_32_64(ext8u):
+    CASE_OP_32_64(ext16s):
+    CASE_OP_32_64(ext16u):
+    case INDEX_op_ext32s_i64:
+    case INDEX_op_ext32u_i64:
+        return true;
+    default:
+        return false;
+    }
+}
+
 /* Reset TEMP's state to TCG_TEMP_ANY.  If TEMP was a representative of some
    class of equivalent temp's, a new representative should be chosen in this
    class. */
@@ -85,6 +216,7 @@ static void reset_temp(TCGArg temp, int nb_temps, int nb_globals)
     if (new_base != (TCGArg)-1 && temps[new_base].next_copy == new_base) {
         temps[new_base].state = TCG_TEMP_ANY;
     }
+    temps[temp].mask = -1;
 }
 
 static int op_bits(TCGOpcode op)
@@ -93,6 +225,65 @@ static int op_bits(TCGOpcode op)
     return def->flags & TCG_OPF_64BIT ? 64 : 32;
 }
 
+/* Mask of the bits of the result that are significant for OP. */
+static tcg_target_ulong op_width_mask(TCGOpcode op)
+{
+    return op_bits(op) == 32 ? 0xffffffff : (tcg_target_ulong)-1;
+}
+
+static tcg_target_ulong temp_mask(TCGArg temp)
+{
+    if (temps[temp].state == TCG_TEMP_CONST) {
+        return temps[temp].val;
+    }
+    return temps[temp].mask;
+}
+
+/* Compute which bits of the result of OP may be nonzero.  The high half
+   of a 32-bit result is never known on a 64-bit host. */
+static tcg_target_ulong op_result_mask(TCGOpcode op, TCGArg *args)
+{
+    tcg_target_ulong mask = -1;
+    tcg_target_ulong m1 = temp_mask(args[1]) & op_width_mask(op);
+
+    switch (op) {
+    CASE_OP_32_64(and):
+        mask = m1 & temp_mask(args[2]);
+        break;
+    CASE_OP_32_64(or):
+    CASE_OP_32_64(xor):
+        mask = m1 | temp_mask(args[2]);
+        break;
+    CASE_OP_32_64(ext8u):
+        mask = m1 & 0xff;
+        break;
+    CASE_OP_32_64(ext16u):
+        mask = m1 & 0xffff;
+        break;
+    case INDEX_op_ext32u_i64:
+        mask = m1 & 0xffffffffu;
+        break;
+    CASE_OP_32_64(shr):
+        if (temps[args[2]].state == TCG_TEMP_CONST &&
+            temps[args[2]].val < op_bits(op)) {
+            mask = m1 >> temps[args[2]].val;
+        }
+        break;
+    CASE_OP_32_64(shl):
+        if (temps[args[2]].state == TCG_TEMP_CONST &&
+            temps[args[2]].val < op_bits(op)) {
+            mask = m1 << temps[args[2]].val;
+        }
+        break;
+    default:
+        break;
+    }
+    if (op_bits(op) == 32) {
+        mask |= ~(tcg_target_ulong)0xffffffff;
+    }
+    return mask;
+}
+
 static TCGOpcode op_to_movi(TCGOpcode op)
 {
     switch (op_bits(op)) {
@@ -129,6 +320,7 @@ static void tcg_opt_gen_mov(TCGContext *s, TCGArg *gen_args, TCGArg dst,
             temps[temps[dst].next_copy].prev_copy = dst;
             temps[src].next_copy = dst;
         }
+        temps[dst].mask = temps[src].mask;
         gen_args[0] = dst;
         gen_args[1] = src;
 }
@@ -139,6 +331,7 @@ static void tcg_opt_gen_movi(TCGArg *gen_args, TCGArg dst, TCGArg val,
         reset_temp(dst, nb_temps, nb_globals);
         temps[dst].state = TCG_TEMP_CONST;
         temps[dst].val = val;
+        temps[dst].mask = val;
         gen_args[0] = dst;
         gen_args[1] = val;
 }
@@ -157,6 +350,30 @@ static TCGOpcode op_to_mov(TCGOpcode op)
     }
 }
 
+/* Replace operation OP_INDEX by a copy of SRC into DST, or by a nop if DST
+   already holds the value of SRC.  Return the number of emitted args. */
+static int tcg_opt_gen_copy(TCGContext *s, int op_index, TCGOpcode op,
+                            TCGArg *gen_args, TCGArg dst, TCGArg src,
+                            int nb_temps, int nb_globals)
+{
+    if (temps[src].state == TCG_TEMP_COPY) {
+        src = temps[src].val;
+    }
+    if ((temps[dst].state == TCG_TEMP_COPY && temps[dst].val == src)
+        || dst == src) {
+        gen_opc_buf[op_index] = INDEX_op_nop;
+        return 0;
+    }
+    if (temps[src].state == TCG_TEMP_CONST) {
+        gen_opc_buf[op_index] = op_to_movi(op);
+        tcg_opt_gen_movi(gen_args, dst, temps[src].val, nb_temps, nb_globals);
+    } else {
+        gen_opc_buf[op_index] = op_to_mov(op);
+        tcg_opt_gen_mov(s, gen_args, dst, src, nb_temps, nb_globals);
+    }
+    return 2;
+}
+
 static TCGArg do_constant_folding_2(TCGOpcode op, TCGArg x, TCGArg y)
 {
     switch (op) {
@@ -275,7 +492,8 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
     TCGOpcode op;
     const TCGOpDef *def;
     TCGArg *gen_args;
-    TCGArg tmp;
+    TCGArg tmp, arg2;
+    tcg_target_ulong mask;
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
        If this temp is a copy of other ones then this equivalence class'
@@ -285,7 +503,7 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
 
     nb_temps = s->nb_temps;
     nb_globals = s->nb_globals;
-    memset(temps, 0, nb_temps * sizeof(struct tcg_temp_info));
+    reset_all_temps(nb_temps);
 
     nb_ops = tcg_opc_ptr - gen_opc_buf;
     gen_args = args;
@@ -322,6 +540,80 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
             break;
         }
 
+        /* Reuse the result of an identical operation on the same inputs
+           earlier in the basic block.  Constant inputs are left to the
+           folding below. */
+        if (op_is_cse_candidate(op)) {
+            arg2 = def->nb_iargs > 1 ? args[2] : (TCGArg)-1;
+            i = cse_lookup(op, args[1], arg2);
+            if (i >= 0 && (temps[args[1]].state != TCG_TEMP_CONST ||
+                           (arg2 != (TCGArg)-1 &&
+                            temps[arg2].state != TCG_TEMP_CONST))) {
+                tmp = cse_table[i].res;
+                cse_invalidate(args[0]);
+                gen_args += tcg_opt_gen_copy(s, op_index, op, gen_args,
+                                             args[0], tmp,
+                                             nb_temps, nb_globals);
+                args += def->nb_args;
+#ifdef CONFIG_PROFILER
+                s->opt_cse_count++;
+#endif
+                continue;
+            }
+        }
+
+        /* Whatever happens below, the outputs of this operation are
+           redefined, so drop the expressions that depend on them. */
+        if (op == INDEX_op_call) {
+            for (i = 0; i < (args[0] >> 16); i++) {
+                cse_invalidate(args[i + 1]);
+            }
+            nb_call_args = (args[0] >> 16) + (args[0] & 0xffff);
+            if (!(args[nb_call_args + 1] & (TCG_CALL_NO_READ_GLOBALS |
+                                            TCG_CALL_NO_WRITE_GLOBALS))) {
+                cse_invalidate_globals(nb_globals);
+            }
+        } else {
+            for (i = 0; i < def->nb_oargs; i++) {
+                cse_invalidate(args[i]);
+            }
+        }
+
+        /* Use the known-zero bits of the inputs: an and with a constant
+           which keeps all bits that may be set, or a zero extension of a
+           value which already fits, is a plain copy. */
+        mask = (tcg_target_ulong)-1;
+        switch (op) {
+        CASE_OP_32_64(and):
+            if (temps[args[2]].state == TCG_TEMP_CONST) {
+                mask = temps[args[2]].val;
+            }
+            break;
+        CASE_OP_32_64(ext8u):
+            mask = 0xff;
+            break;
+        CASE_OP_32_64(ext16u):
+            mask = 0xffff;
+            break;
+        case INDEX_op_ext32u_i64:
+            mask = 0xffffffffu;
+            break;
+        default:
+            break;
+        }
+        if (mask != (tcg_target_ulong)-1
+            && temps[args[1]].state != TCG_TEMP_CONST
+            && (temp_mask(args[1]) & ~mask & op_width_mask(op)) == 0) {
+            gen_args += tcg_opt_gen_copy(s, op_index, op, gen_args,
+                                         args[0], args[1],
+                                         nb_temps, nb_globals);
+            args += def->nb_args;
+#ifdef CONFIG_PROFILER
+            s->opt_mask_count++;
+#endif
+            continue;
+        }
+
         /* Simplify expression if possible. */
         switch (op) {
         CASE_OP_32_64(add):
@@ -428,7 +720,10 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                 args += 2;
                 break;
             } else {
+                mask = op_result_mask(op, args);
                 reset_temp(args[0], nb_temps, nb_globals);
+                temps[args[0]].mask = mask;
+                cse_record(op, args[1], (TCGArg)-1, args[0]);
                 gen_args[0] = args[0];
                 gen_args[1] = args[1];
                 gen_args += 2;
@@ -461,7 +756,10 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                 args += 3;
                 break;
             } else {
+                mask = op_result_mask(op, args);
                 reset_temp(args[0], nb_temps, nb_globals);
+                temps[args[0]].mask = mask;
+                cse_record(op, args[1], args[2], args[0]);
                 gen_args[0] = args[0];
                 gen_args[1] = args[1];
                 gen_args[2] = args[2];
@@ -471,7 +769,8 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
             }
         case INDEX_op_call:
             nb_call_args = (args[0] >> 16) + (args[0] & 0xffff);
-            if (!(args[nb_call_args + 1] & (TCG_CALL_CONST | TCG_CALL_PURE))) {
+            if (!(args[nb_call_args + 1] & (TCG_CALL_NO_READ_GLOBALS |
+                                            TCG_CALL_NO_WRITE_GLOBALS))) {
                 for (i = 0; i < nb_globals; i++) {
                     reset_temp(i, nb_temps, nb_globals);
                 }
@@ -491,7 +790,7 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
         case INDEX_op_jmp:
         case INDEX_op_br:
         CASE_OP_32_64(brcond):
-            memset(temps, 0, nb_temps * sizeof(struct tcg_temp_info));
+            reset_all_temps(nb_temps);
             for (i = 0; i < def->nb_args; i++) {
                 *gen_args = *args;
                 args++;
@@ -516,10 +815,31 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
     return gen_args;
 }
 
+#ifdef CONFIG_PROFILER
+static int count_live_ops(uint16_t *tcg_opc_ptr)
+{
+    uint16_t *opc;
+    int n = 0;
+
+    for (opc = gen_opc_buf; opc < tcg_opc_ptr; opc++) {
+        if (*opc != INDEX_op_nop) {
+            n++;
+        }
+    }
+    return n;
+}
+#endif
+
 TCGArg *tcg_optimize(TCGContext *s, uint16_t *tcg_opc_ptr,
         TCGArg *args, TCGOpDef *tcg_op_defs)
 {
     TCGArg *res;
+#ifdef CONFIG_PROFILER
+    int nb_ops = count_live_ops(tcg_opc_ptr);
+#endif
     res = tcg_constant_folding(s, tcg_opc_ptr, args, tcg_op_defs);
+#ifdef CONFIG_PROFILER
+    s->opt_del_op_count += nb_ops - count_live_ops(tcg_opc_ptr);
+#endif
     return res;
 }
@@ -2023,8 +2023,11 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
     case INDEX_op_jmp:
-        /* This one is obsolete and never emitted.  */
-        tcg_abort();
+        if (const_args[0]) {
+            tgen_gotoi(s, S390_CC_ALWAYS, args[0]);
+        } else {
+            tcg_out_insn(s, RR, BCR, S390_CC_ALWAYS, args[0]);
+        }
         break;
 
     default:
@@ -1166,6 +1166,10 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
                      sizeof(long), HOST_LD_OP);
         break;
     case INDEX_op_jmp:
+        tcg_out32(s, JMPL | INSN_RD(TCG_REG_G0) | INSN_RS1(args[0]) |
+                  INSN_RS2(TCG_REG_G0));
+        tcg_out_nop(s);
+        break;
     case INDEX_op_br:
         tcg_out_branch_i32(s, COND_A, args[0]);
         tcg_out_nop(s);
@@ -1430,7 +1434,7 @@ static const TCGTargetOpDef sparc_op_defs[] = {
     { INDEX_op_exit_tb, { } },
     { INDEX_op_goto_tb, { } },
     { INDEX_op_call, { "ri" } },
-    { INDEX_op_jmp, { "ri" } },
+    { INDEX_op_jmp, { "r" } },
     { INDEX_op_br, { } },
 
     { INDEX_op_mov_i32, { "r", "r" } },
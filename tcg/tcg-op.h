@@ -396,9 +396,9 @@ static inline void tcg_gen_helperN(void *func, int flags, int sizemask,
 }
 
 /* Note: Both tcg_gen_helper32() and tcg_gen_helper64() are currently
-   reserved for helpers in tcg-runtime.c. These helpers are all const
-   and pure, hence the call to tcg_gen_callN() with TCG_CALL_CONST |
-   TCG_CALL_PURE. This may need to be adjusted if these functions
+   reserved for helpers in tcg-runtime.c. These helpers neither access
+   globals nor have side effects, hence the call to tcg_gen_callN() with
+   TCG_CALL_NO_RWG_SE. This may need to be adjusted if these functions
    start to be used with other helpers. */
 static inline void tcg_gen_helper32(void *func, int sizemask, TCGv_i32 ret,
                                     TCGv_i32 a, TCGv_i32 b)
@@ -408,7 +408,7 @@ static inline void tcg_gen_helper32(void *func, int sizemask, TCGv_i32 ret,
     fn = tcg_const_ptr(func);
     args[0] = GET_TCGV_I32(a);
     args[1] = GET_TCGV_I32(b);
-    tcg_gen_callN(&tcg_ctx, fn, TCG_CALL_CONST | TCG_CALL_PURE, sizemask,
+    tcg_gen_callN(&tcg_ctx, fn, TCG_CALL_NO_RWG_SE, sizemask,
                   GET_TCGV_I32(ret), 2, args);
     tcg_temp_free_ptr(fn);
 }
@@ -421,7 +421,7 @@ static inline void tcg_gen_helper64(void *func, int sizemask, TCGv_i64 ret,
     fn = tcg_const_ptr(func);
     args[0] = GET_TCGV_I64(a);
     args[1] = GET_TCGV_I64(b);
-    tcg_gen_callN(&tcg_ctx, fn, TCG_CALL_CONST | TCG_CALL_PURE, sizemask,
+    tcg_gen_callN(&tcg_ctx, fn, TCG_CALL_NO_RWG_SE, sizemask,
                   GET_TCGV_I64(ret), 2, args);
     tcg_temp_free_ptr(fn);
 }
@@ -2171,6 +2171,14 @@ static inline void tcg_gen_goto_tb(int idx)
     tcg_gen_op1i(INDEX_op_goto_tb, idx);
 }
 
+/* Jump to the host code at PTR, the start of a TB or
+   tcg_ctx.code_gen_epilogue.  */
+static inline void tcg_gen_jmp_ptr(TCGv_ptr ptr)
+{
+    *gen_opc_ptr++ = INDEX_op_jmp;
+    *gen_opparam_ptr++ = GET_TCGV_PTR(ptr);
+}
+
 #if TCG_TARGET_REG_BITS == 32
 static inline void tcg_gen_qemu_ld8u(TCGv ret, TCGv addr, int mem_index)
 {
@@ -2357,6 +2365,40 @@ static inline void tcg_gen_qemu_st64(TCGv_i64 arg, TCGv addr, int mem_index)
     tcg_gen_qemu_ldst_op_i64(INDEX_op_qemu_st64, arg, addr, mem_index);
 }
 
+/* Atomic read-modify-write of 1 << SIZE bytes at ADDR; RET receives the
+   old value.  Only usable if TCG_TARGET_HAS_qemu_atomic.  */
+static inline void tcg_gen_qemu_cmpxchg(TCGv ret, TCGv addr, TCGv cmpv,
+                                        TCGv newv, int mem_index, int size)
+{
+#if TARGET_LONG_BITS == 32
+    tcg_gen_op6ii_i32(INDEX_op_qemu_cmpxchg, ret, cmpv, newv, addr,
+                      mem_index, size);
+#else
+    tcg_gen_op6ii_i64(INDEX_op_qemu_cmpxchg, ret, cmpv, newv, addr,
+                      mem_index, size);
+#endif
+}
+
+static inline void tcg_gen_qemu_xadd(TCGv ret, TCGv addr, TCGv val,
+                                     int mem_index, int size)
+{
+#if TARGET_LONG_BITS == 32
+    tcg_gen_op5ii_i32(INDEX_op_qemu_xadd, ret, val, addr, mem_index, size);
+#else
+    tcg_gen_op5ii_i64(INDEX_op_qemu_xadd, ret, val, addr, mem_index, size);
+#endif
+}
+
+static inline void tcg_gen_qemu_xchg(TCGv ret, TCGv addr, TCGv val,
+                                     int mem_index, int size)
+{
+#if TARGET_LONG_BITS == 32
+    tcg_gen_op5ii_i32(INDEX_op_qemu_xchg, ret, val, addr, mem_index, size);
+#else
+    tcg_gen_op5ii_i64(INDEX_op_qemu_xchg, ret, val, addr, mem_index, size);
+#endif
+}
+
 #define tcg_gen_ld_ptr(R, A, O) tcg_gen_ld_i64(TCGV_PTR_TO_NAT(R), (A), (O))
 #define tcg_gen_discard_ptr(A) tcg_gen_discard_i64(TCGV_PTR_TO_NAT(A))
 
@@ -261,10 +261,15 @@ void tcg_context_init(TCGContext *s)
 
 void tcg_prologue_init(TCGContext *s)
 {
+    static const TCGArg exit_args[1] = { 0 };
+    static const int exit_const_args[1] = { 0 };
+
     /* init global prologue and epilogue */
     s->code_buf = code_gen_prologue;
     s->code_ptr = s->code_buf;
     tcg_target_qemu_prologue(s);
+    s->code_gen_epilogue = s->code_ptr;
+    tcg_out_op(s, INDEX_op_exit_tb, exit_args, exit_const_args);
     flush_icache_range((unsigned long)s->code_buf, 
                        (unsigned long)s->code_ptr);
 }
@@ -1222,17 +1227,21 @@ static void tcg_liveness_analysis(TCGContext *s)
     TCGOpcode op;
     TCGArg *args;
     const TCGOpDef *def;
-    uint8_t *dead_temps;
-    unsigned int dead_args;
+    uint8_t *dead_temps, *read_temps;
+    unsigned int dead_args, reused_args;
     
     gen_opc_ptr++; /* skip end */
 
     nb_ops = gen_opc_ptr - gen_opc_buf;
 
     s->op_dead_args = tcg_malloc(nb_ops * sizeof(uint16_t));
+    s->op_reused_args = tcg_malloc(nb_ops * sizeof(uint16_t));
     
     dead_temps = tcg_malloc(s->nb_temps);
     memset(dead_temps, 1, s->nb_temps);
+    /* temporaries read later in the current basic block */
+    read_temps = tcg_malloc(s->nb_temps);
+    memset(read_temps, 0, s->nb_temps);
 
     args = gen_opparam_ptr;
     op_index = nb_ops - 1;
@@ -1251,9 +1260,9 @@ static void tcg_liveness_analysis(TCGContext *s)
                 args++;
                 call_flags = args[nb_oargs + nb_iargs];
 
-                /* pure functions can be removed if their result is not
-                   used */
-                if (call_flags & TCG_CALL_PURE) {
+                /* calls without side effects can be removed if their
+                   result is not used */
+                if (call_flags & TCG_CALL_NO_SIDE_EFFECTS) {
                     for(i = 0; i < nb_oargs; i++) {
                         arg = args[i];
                         if (!dead_temps[arg])
@@ -1261,6 +1270,9 @@ static void tcg_liveness_analysis(TCGContext *s)
                     }
                     tcg_set_nop(s, gen_opc_buf + op_index, 
                                 args - 1, nb_args);
+#ifdef CONFIG_PROFILER
+                    s->del_op_count++;
+#endif
                 } else {
                 do_not_remove_call:
 
@@ -1272,14 +1284,20 @@ static void tcg_liveness_analysis(TCGContext *s)
                             dead_args |= (1 << i);
                         }
                         dead_temps[arg] = 1;
+                        read_temps[arg] = 0;
                     }
                     
-                    if (!(call_flags & TCG_CALL_CONST)) {
+                    if (!(call_flags & TCG_CALL_NO_READ_GLOBALS)) {
                         /* globals are live (they may be used by the call) */
                         memset(dead_temps, 0, s->nb_globals);
+                        if (!(call_flags & TCG_CALL_NO_WRITE_GLOBALS)) {
+                            /* and are reloaded after it */
+                            memset(read_temps, 0, s->nb_globals);
+                        }
                     }
 
                     /* input args are live */
+                    reused_args = 0;
                     for(i = nb_oargs; i < nb_iargs + nb_oargs; i++) {
                         arg = args[i];
                         if (arg != TCG_CALL_DUMMY_ARG) {
@@ -1287,9 +1305,14 @@ static void tcg_liveness_analysis(TCGContext *s)
                                 dead_args |= (1 << i);
                             }
                             dead_temps[arg] = 0;
+                            if (read_temps[arg]) {
+                                reused_args |= (1 << i);
+                            }
+                            read_temps[arg] = 1;
                         }
                     }
                     s->op_dead_args[op_index] = dead_args;
+                    s->op_reused_args[op_index] = reused_args;
                 }
                 args--;
             }
@@ -1298,6 +1321,7 @@ static void tcg_liveness_analysis(TCGContext *s)
             args--;
             /* mark end of basic block */
             tcg_la_bb_end(s, dead_temps);
+            memset(read_temps, 0, s->nb_temps);
             break;
         case INDEX_op_debug_insn_start:
             args -= def->nb_args;
@@ -1310,6 +1334,7 @@ static void tcg_liveness_analysis(TCGContext *s)
             args--;
             /* mark the temporary as dead */
             dead_temps[args[0]] = 1;
+            read_temps[args[0]] = 0;
             break;
         case INDEX_op_end:
             break;
@@ -1343,25 +1368,34 @@ static void tcg_liveness_analysis(TCGContext *s)
                         dead_args |= (1 << i);
                     }
                     dead_temps[arg] = 1;
+                    read_temps[arg] = 0;
                 }
 
                 /* if end of basic block, update */
                 if (def->flags & TCG_OPF_BB_END) {
                     tcg_la_bb_end(s, dead_temps);
+                    memset(read_temps, 0, s->nb_temps);
                 } else if (def->flags & TCG_OPF_CALL_CLOBBER) {
                     /* globals are live */
                     memset(dead_temps, 0, s->nb_globals);
+                    memset(read_temps, 0, s->nb_globals);
                 }
 
                 /* input args are live */
+                reused_args = 0;
                 for(i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
                     arg = args[i];
                     if (dead_temps[arg]) {
                         dead_args |= (1 << i);
                     }
                     dead_temps[arg] = 0;
+                    if (read_temps[arg]) {
+                        reused_args |= (1 << i);
+                    }
+                    read_temps[arg] = 1;
                 }
                 s->op_dead_args[op_index] = dead_args;
+                s->op_reused_args[op_index] = reused_args;
             }
             break;
         }
@@ -1380,6 +1414,8 @@ static void tcg_liveness_analysis(TCGContext *s)
 
     s->op_dead_args = tcg_malloc(nb_ops * sizeof(uint16_t));
     memset(s->op_dead_args, 0, nb_ops * sizeof(uint16_t));
+    s->op_reused_args = tcg_malloc(nb_ops * sizeof(uint16_t));
+    memset(s->op_reused_args, 0, nb_ops * sizeof(uint16_t));
 }
 #endif
 
@@ -1510,7 +1546,17 @@ static int tcg_reg_alloc(TCGContext *s, TCGRegSet reg1, TCGRegSet reg2)
             return reg;
     }
 
-    /* XXX: do better spill choice */
+    /* then registers whose value is already in memory, since spilling
+       them costs no store */
+    for(i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
+        reg = tcg_target_reg_alloc_order[i];
+        if (tcg_regset_test_reg(reg_ct, reg) &&
+            s->temps[s->reg_to_temp[reg]].mem_coherent) {
+            tcg_reg_free(s, reg);
+            return reg;
+        }
+    }
+
     for(i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
         reg = tcg_target_reg_alloc_order[i];
         if (tcg_regset_test_reg(reg_ct, reg)) {
@@ -1522,6 +1568,63 @@ static int tcg_reg_alloc(TCGContext *s, TCGRegSet reg1, TCGRegSet reg2)
     tcg_abort();
 }
 
+/* free register 'reg' before an instruction that clobbers it.  A
+   temporary held in a register is still live (registers of dead
+   temporaries are released at their last use), so rather than spilling
+   it, move it to a free register that is neither in 'clobbered' nor in
+   'allocated_regs'.  This splits its live range around the instruction
+   and saves a store and a reload. */
+static void tcg_reg_evict(TCGContext *s, int reg, TCGRegSet clobbered,
+                          TCGRegSet allocated_regs)
+{
+    TCGTemp *ts;
+    TCGRegSet reg_ct;
+    int i, temp, new_reg;
+
+    temp = s->reg_to_temp[reg];
+    if (temp == -1) {
+        return;
+    }
+    ts = &s->temps[temp];
+    tcg_regset_or(reg_ct, clobbered, allocated_regs);
+    tcg_regset_or(reg_ct, reg_ct, s->reserved_regs);
+    tcg_regset_andnot(reg_ct, tcg_target_available_regs[ts->type], reg_ct);
+    for(i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
+        new_reg = tcg_target_reg_alloc_order[i];
+        if (tcg_regset_test_reg(reg_ct, new_reg) &&
+            s->reg_to_temp[new_reg] == -1) {
+            tcg_out_mov(s, ts->type, new_reg, reg);
+            s->reg_to_temp[reg] = -1;
+            s->reg_to_temp[new_reg] = temp;
+            ts->reg = new_reg;
+            return;
+        }
+    }
+    tcg_reg_free(s, reg);
+}
+
+/* free the call clobbered registers.  Globals are moved rather than
+   spilled only if 'globals_saved' is false, i.e. the call neither reads
+   nor writes them. */
+static void tcg_reg_free_call_clobbered(TCGContext *s, TCGRegSet allocated_regs,
+                                        int globals_saved)
+{
+    int reg, temp;
+
+    for(reg = 0; reg < TCG_TARGET_NB_REGS; reg++) {
+        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, reg)) {
+            temp = s->reg_to_temp[reg];
+            if (temp != -1 && temp < s->nb_globals && globals_saved) {
+                /* save_globals() releases it anyway */
+                tcg_reg_free(s, reg);
+            } else {
+                tcg_reg_evict(s, reg, tcg_target_call_clobber_regs,
+                              allocated_regs);
+            }
+        }
+    }
+}
+
 /* save a temporary to memory. 'allocated_regs' is used in case a
    temporary registers needs to be allocated to store a constant. */
 static void temp_save(TCGContext *s, int temp, TCGRegSet allocated_regs)
@@ -1567,6 +1670,80 @@ static void save_globals(TCGContext *s, TCGRegSet allocated_regs)
     }
 }
 
+/* store a temporary to memory, but keep it in a register if it already
+   is in one.  Constants are loaded into a register for the store, which
+   then holds the temporary. */
+static void temp_sync(TCGContext *s, int temp, TCGRegSet allocated_regs)
+{
+    TCGTemp *ts;
+    int reg;
+
+    ts = &s->temps[temp];
+    if (ts->fixed_reg) {
+        return;
+    }
+    switch(ts->val_type) {
+    case TEMP_VAL_REG:
+        if (!ts->mem_coherent) {
+            if (!ts->mem_allocated)
+                temp_allocate_frame(s, temp);
+            tcg_out_st(s, ts->type, ts->reg, ts->mem_reg, ts->mem_offset);
+            ts->mem_coherent = 1;
+        }
+        break;
+    case TEMP_VAL_CONST:
+        reg = tcg_reg_alloc(s, tcg_target_available_regs[ts->type],
+                            allocated_regs);
+        if (!ts->mem_allocated)
+            temp_allocate_frame(s, temp);
+        tcg_out_movi(s, ts->type, reg, ts->val);
+        tcg_out_st(s, ts->type, reg, ts->mem_reg, ts->mem_offset);
+        ts->val_type = TEMP_VAL_REG;
+        ts->reg = reg;
+        ts->mem_coherent = 1;
+        s->reg_to_temp[reg] = temp;
+        break;
+    default:
+        temp_save(s, temp, allocated_regs);
+        break;
+    }
+}
+
+/* store globals to their canonical location, keeping the ones that are
+   in registers there. */
+static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
+{
+    int i;
+
+    for(i = 0; i < s->nb_globals; i++) {
+        temp_sync(s, i, allocated_regs);
+    }
+}
+
+/* at a conditional branch, the globals and local temporaries must be at
+   their canonical location for the branch target, but on the fall
+   through path the registers still hold their values and need not be
+   reloaded.  Other temporaries are dead, as at any basic block end. */
+static void tcg_reg_alloc_cond_branch(TCGContext *s, TCGRegSet allocated_regs)
+{
+    TCGTemp *ts;
+    int i;
+
+    for(i = s->nb_globals; i < s->nb_temps; i++) {
+        ts = &s->temps[i];
+        if (ts->temp_local) {
+            temp_sync(s, i, allocated_regs);
+        } else {
+            if (ts->val_type == TEMP_VAL_REG) {
+                s->reg_to_temp[ts->reg] = -1;
+            }
+            ts->val_type = TEMP_VAL_DEAD;
+        }
+    }
+
+    sync_globals(s, allocated_regs);
+}
+
 /* at the end of a basic block, we assume all temporaries are dead and
    all globals are stored at their canonical location. */
 static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
@@ -1590,6 +1767,7 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
 }
 
 #define IS_DEAD_ARG(n) ((dead_args >> (n)) & 1)
+#define IS_REUSED_ARG(n) ((reused_args >> (n)) & 1)
 
 static void tcg_reg_alloc_movi(TCGContext *s, const TCGArg *args)
 {
@@ -1614,7 +1792,8 @@ static void tcg_reg_alloc_movi(TCGContext *s, const TCGArg *args)
 
 static void tcg_reg_alloc_mov(TCGContext *s, const TCGOpDef *def,
                               const TCGArg *args,
-                              unsigned int dead_args)
+                              unsigned int dead_args,
+                              unsigned int reused_args)
 {
     TCGTemp *ts, *ots;
     int reg;
@@ -1624,6 +1803,18 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOpDef *def,
     ts = &s->temps[args[1]];
     arg_ct = &def->args_ct[0];
 
+    if (ts->val_type == TEMP_VAL_MEM && IS_REUSED_ARG(1)) {
+        /* the source is read again in this basic block: load it into a
+           register of its own so that it is not loaded again */
+        reg = tcg_reg_alloc(s, tcg_target_available_regs[ts->type],
+                            s->reserved_regs);
+        tcg_out_ld(s, ts->type, reg, ts->mem_reg, ts->mem_offset);
+        ts->val_type = TEMP_VAL_REG;
+        ts->reg = reg;
+        ts->mem_coherent = 1;
+        s->reg_to_temp[reg] = args[1];
+    }
+
     /* XXX: always mark arg dead if IS_DEAD_ARG(1) */
     if (ts->val_type == TEMP_VAL_REG) {
         if (IS_DEAD_ARG(1) && !ts->fixed_reg && !ots->fixed_reg) {
@@ -1637,7 +1828,9 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOpDef *def,
             if (ots->val_type == TEMP_VAL_REG) {
                 reg = ots->reg;
             } else {
-                reg = tcg_reg_alloc(s, arg_ct->u.regs, s->reserved_regs);
+                TCGRegSet allocated_regs = s->reserved_regs;
+                tcg_regset_set_reg(allocated_regs, ts->reg);
+                reg = tcg_reg_alloc(s, arg_ct->u.regs, allocated_regs);
             }
             if (ts->reg != reg) {
                 tcg_out_mov(s, ots->type, reg, ts->reg);
@@ -1754,7 +1947,9 @@ static void tcg_reg_alloc_op(TCGContext *s,
     iarg_end: ;
     }
     
-    if (def->flags & TCG_OPF_BB_END) {
+    if (def->flags & TCG_OPF_COND_BRANCH) {
+        tcg_reg_alloc_cond_branch(s, allocated_regs);
+    } else if (def->flags & TCG_OPF_BB_END) {
         tcg_reg_alloc_bb_end(s, allocated_regs);
     } else {
         /* mark dead temporaries and free the associated registers */
@@ -1772,11 +1967,7 @@ static void tcg_reg_alloc_op(TCGContext *s,
         
         if (def->flags & TCG_OPF_CALL_CLOBBER) {
             /* XXX: permit generic clobber register list ? */ 
-            for(reg = 0; reg < TCG_TARGET_NB_REGS; reg++) {
-                if (tcg_regset_test_reg(tcg_target_call_clobber_regs, reg)) {
-                    tcg_reg_free(s, reg);
-                }
-            }
+            tcg_reg_free_call_clobbered(s, allocated_regs, 1);
             /* XXX: for load/store we could do that only for the slow path
                (i.e. when a memory callback is called) */
             
@@ -1851,7 +2042,7 @@ static int tcg_reg_alloc_call(TCGContext *s, const TCGOpDef *def,
     TCGArg arg, func_arg;
     TCGTemp *ts;
     tcg_target_long stack_offset, call_stack_size, func_addr;
-    int const_func_arg, allocate_args;
+    int const_func_arg, allocate_args, globals_saved;
     TCGRegSet allocated_regs;
     const TCGArgConstraint *arg_ct;
 
@@ -1916,7 +2107,10 @@ static int tcg_reg_alloc_call(TCGContext *s, const TCGOpDef *def,
         if (arg != TCG_CALL_DUMMY_ARG) {
             ts = &s->temps[arg];
             reg = tcg_target_call_iarg_regs[i];
-            tcg_reg_free(s, reg);
+            if (s->reg_to_temp[reg] != arg) {
+                tcg_reg_evict(s, reg, tcg_target_call_clobber_regs,
+                              allocated_regs);
+            }
             if (ts->val_type == TEMP_VAL_REG) {
                 if (ts->reg != reg) {
                     tcg_out_mov(s, ts->type, reg, ts->reg);
@@ -1980,16 +2174,22 @@ static int tcg_reg_alloc_call(TCGContext *s, const TCGOpDef *def,
         }
     }
     
-    /* clobber call registers */
-    for(reg = 0; reg < TCG_TARGET_NB_REGS; reg++) {
-        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, reg)) {
-            tcg_reg_free(s, reg);
-        }
+    /* a call that reads globals needs them in memory, but they only
+       have to be reloaded afterwards if it can modify them */
+    globals_saved = !(flags & (TCG_CALL_NO_READ_GLOBALS |
+                               TCG_CALL_NO_WRITE_GLOBALS));
+    if (!(flags & TCG_CALL_NO_READ_GLOBALS) && !globals_saved) {
+        sync_globals(s, allocated_regs);
     }
+
+    /* clobber call registers.  Live temporaries, and globals if the
+       call does not modify them, are moved to call saved registers
+       when possible. */
+    tcg_reg_free_call_clobbered(s, allocated_regs, globals_saved);
     
     /* store globals and free associated registers (we assume the call
        can modify any global. */
-    if (!(flags & TCG_CALL_CONST)) {
+    if (globals_saved) {
         save_globals(s, allocated_regs);
     }
 
@@ -2057,8 +2257,10 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
 #endif
 
 #ifdef USE_TCG_OPTIMIZATIONS
-    gen_opparam_ptr =
-        tcg_optimize(s, gen_opc_ptr, gen_opparam_buf, tcg_op_defs);
+    if (!s->skip_optimize) {
+        gen_opparam_ptr =
+            tcg_optimize(s, gen_opc_ptr, gen_opparam_buf, tcg_op_defs);
+    }
 #endif
 
 #ifdef CONFIG_PROFILER
@@ -2102,7 +2304,8 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
         case INDEX_op_mov_i64:
 #endif
             dead_args = s->op_dead_args[op_index];
-            tcg_reg_alloc_mov(s, def, args, dead_args);
+            tcg_reg_alloc_mov(s, def, args, dead_args,
+                              s->op_reused_args[op_index]);
             break;
         case INDEX_op_movi_i32:
 #if TCG_TARGET_REG_BITS == 64
@@ -2157,6 +2360,7 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
         }
         args += def->nb_args;
     next:
+        gen_opc_host_end[op_index] = s->code_ptr - gen_code_buf;
         if (search_pc >= 0 && search_pc < s->code_ptr - gen_code_buf) {
             return op_index;
         }
@@ -2220,6 +2424,10 @@ void tcg_dump_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "deleted ops/TB      %0.2f\n",
                 s->tb_count ? 
                 (double)s->del_op_count / s->tb_count : 0);
+    cpu_fprintf(f, "optimized ops/TB    %0.2f (cse %0.2f known bits %0.2f)\n",
+                s->tb_count ? (double)s->opt_del_op_count / s->tb_count : 0,
+                s->tb_count ? (double)s->opt_cse_count / s->tb_count : 0,
+                s->tb_count ? (double)s->opt_mask_count / s->tb_count : 0);
     cpu_fprintf(f, "avg temps/TB        %0.2f max=%d\n",
                 s->tb_count ? 
                 (double)s->temp_count / s->tb_count : 0,
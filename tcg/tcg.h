@@ -81,6 +81,10 @@ typedef uint64_t TCGRegSet;
 #define TCG_TARGET_HAS_deposit_i64      0
 #endif
 
+#ifndef TCG_TARGET_HAS_qemu_atomic
+#define TCG_TARGET_HAS_qemu_atomic      0
+#endif
+
 #ifndef TCG_TARGET_deposit_i32_valid
 #define TCG_TARGET_deposit_i32_valid(ofs, len) 1
 #endif
@@ -257,14 +261,24 @@ typedef int TCGv_i64;
 #define TCG_CALL_TYPE_REGPARM_1 0x0001 /* i386 style regparm call (1 reg) */
 #define TCG_CALL_TYPE_REGPARM_2 0x0002 /* i386 style regparm call (2 regs) */
 #define TCG_CALL_TYPE_REGPARM   0x0003 /* i386 style regparm call (3 regs) */
-/* A pure function only reads its arguments and TCG global variables
-   and cannot raise exceptions. Hence a call to a pure function can be
-   safely suppressed if the return value is not used. */
-#define TCG_CALL_PURE           0x0010 
-/* A const function only reads its arguments and does not use TCG
-   global variables. Hence a call to such a function does not
-   save TCG global variables back to their canonical location. */
-#define TCG_CALL_CONST          0x0020
+/* The helper does not read TCG global variables, neither directly
+   nor through an exception, so they need not be saved back to their
+   canonical location before the call.  Implies
+   TCG_CALL_NO_WRITE_GLOBALS. */
+#define TCG_CALL_NO_READ_GLOBALS    0x0010
+/* The helper does not modify TCG global variables, so they are stored
+   before the call but stay valid in registers after it. */
+#define TCG_CALL_NO_WRITE_GLOBALS   0x0020
+/* The helper has no side effects and cannot raise exceptions, so the
+   call can be removed if its return value is not used.  */
+#define TCG_CALL_NO_SIDE_EFFECTS    0x0040
+
+/* the usual combinations */
+#define TCG_CALL_NO_RWG         TCG_CALL_NO_READ_GLOBALS
+#define TCG_CALL_NO_WG          TCG_CALL_NO_WRITE_GLOBALS
+#define TCG_CALL_NO_SE          TCG_CALL_NO_SIDE_EFFECTS
+#define TCG_CALL_NO_RWG_SE      (TCG_CALL_NO_RWG | TCG_CALL_NO_SE)
+#define TCG_CALL_NO_WG_SE       (TCG_CALL_NO_WG | TCG_CALL_NO_SE)
 
 /* used to align parameters */
 #define TCG_CALL_DUMMY_TCGV     MAKE_TCGV_I32(-1)
@@ -351,10 +365,19 @@ struct TCGContext {
     unsigned long *tb_next;
     uint16_t *tb_next_offset;
     uint16_t *tb_jmp_offset; /* != NULL if USE_DIRECT_JUMP */
+    /* exit_tb(0) after the prologue, jump target for indirect branches
+       that have to go back to cpu_exec() */
+    uint8_t *code_gen_epilogue;
+    /* generate code without running tcg_optimize(), for blocks that are
+       not known to be hot yet */
+    int skip_optimize;
 
     /* liveness analysis */
     uint16_t *op_dead_args; /* for each operation, each bit tells if the
                                corresponding argument is dead */
+    uint16_t *op_reused_args; /* for each operation, each bit tells if the
+                                 corresponding input argument is read again
+                                 before the end of the basic block */
     
     /* tells in which temporary a given register is. It does not take
        into account fixed registers */
@@ -382,6 +405,9 @@ struct TCGContext {
     int64_t temp_count;
     int temp_count_max;
     int64_t del_op_count;
+    int64_t opt_del_op_count; /* ops removed by tcg_optimize */
+    int64_t opt_cse_count;
+    int64_t opt_mask_count;
     int64_t code_in_len;
     int64_t code_out_len;
     int64_t interm_time;
@@ -401,6 +427,8 @@ extern uint16_t *gen_opc_ptr;
 extern TCGArg *gen_opparam_ptr;
 extern uint16_t gen_opc_buf[];
 extern TCGArg gen_opparam_buf[];
+/* offset of the end of the host code of each op, set by tcg_gen_code */
+extern uint16_t gen_opc_host_end[];
 
 /* pool based memory allocation */
 
@@ -511,6 +539,9 @@ enum {
     TCG_OPF_64BIT        = 0x08,
     /* Instruction is optional and not implemented by the host.  */
     TCG_OPF_NOT_PRESENT  = 0x10,
+    /* Instruction is a conditional branch: execution may continue
+       with the next instruction.  */
+    TCG_OPF_COND_BRANCH  = 0x20,
 };
 
 typedef struct TCGOpDef {
@@ -406,7 +406,12 @@ static int target_parse_constraint(TCGArgConstraint *ct, const char **pct_str)
 /* Show current bytecode. Used by tcg interpreter. */
 void tci_disas(uint8_t opc)
 {
-    const TCGOpDef *def = &tcg_op_defs[opc];
+    const TCGOpDef *def;
+    if (opc >= NB_OPS) {
+        fprintf(stderr, "TCG superinstruction %u\n", opc);
+        return;
+    }
+    def = &tcg_op_defs[opc];
     fprintf(stderr, "TCG %s %u, %u, %u\n",
             def->name, def->nb_oargs, def->nb_iargs, def->nb_cargs);
 }
@@ -491,6 +496,75 @@ static void tci_out_label(TCGContext *s, TCGArg arg)
     }
 }
 
+#if defined(TCI_THREADED)
+/* Last operation written and second half of the last superinstruction. */
+static uint8_t *tci_last_op;
+static uint8_t *tci_fused_op;
+
+/* Merge the operation at op_ptr with the operation written just before it
+   into a superinstruction when the pair is a known one. Only the opcode of
+   the first operation is changed. An operation which already is the second
+   half of a pair is never made the first half of another one, because the
+   interpreter continues with its original handler. */
+static void tci_out_fuse(TCGContext *s, uint8_t *op_ptr)
+{
+    uint8_t *prev = tci_last_op;
+    int fused = -1;
+
+    tci_last_op = op_ptr;
+    if (prev < s->code_buf || prev >= op_ptr || prev + prev[1] != op_ptr ||
+        prev == tci_fused_op) {
+        return;
+    }
+    switch (prev[0]) {
+    case INDEX_op_ld_i32:
+        if (op_ptr[0] == INDEX_op_add_i32) {
+            fused = INDEX_op_tci_ld_add_i32;
+        }
+        break;
+    case INDEX_op_st_i32:
+        if (op_ptr[0] == INDEX_op_st_i32) {
+            fused = INDEX_op_tci_st_st_i32;
+        }
+        break;
+    case INDEX_op_setcond_i32:
+        if (op_ptr[0] == INDEX_op_brcond_i32) {
+            fused = INDEX_op_tci_setcond_brcond_i32;
+        }
+        break;
+#if TCG_TARGET_REG_BITS == 64
+    case INDEX_op_ld_i64:
+        if (op_ptr[0] == INDEX_op_add_i64) {
+            fused = INDEX_op_tci_ld_add_i64;
+        } else if (op_ptr[0] == INDEX_op_ld_i64) {
+            fused = INDEX_op_tci_ld_ld_i64;
+        }
+        break;
+    case INDEX_op_st_i64:
+        if (op_ptr[0] == INDEX_op_st_i64) {
+            fused = INDEX_op_tci_st_st_i64;
+        }
+        break;
+    case INDEX_op_setcond_i64:
+        if (op_ptr[0] == INDEX_op_brcond_i64) {
+            fused = INDEX_op_tci_setcond_brcond_i64;
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+    if (fused >= 0) {
+        prev[0] = fused;
+        tci_fused_op = op_ptr;
+    }
+}
+#else
+static inline void tci_out_fuse(TCGContext *s, uint8_t *op_ptr)
+{
+}
+#endif
+
 static void tcg_out_ld(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg1,
                        tcg_target_long arg2)
 {
@@ -513,6 +587,7 @@ static void tcg_out_ld(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg1,
 #endif
     }
     old_code_ptr[1] = s->code_ptr - old_code_ptr;
+    tci_out_fuse(s, old_code_ptr);
 }
 
 static void tcg_out_mov(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg)
@@ -527,6 +602,7 @@ static void tcg_out_mov(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg)
     tcg_out_r(s, ret);
     tcg_out_r(s, arg);
     old_code_ptr[1] = s->code_ptr - old_code_ptr;
+    tci_out_fuse(s, old_code_ptr);
 }
 
 static void tcg_out_movi(TCGContext *s, TCGType type,
@@ -549,6 +625,7 @@ static void tcg_out_movi(TCGContext *s, TCGType type,
 #endif
     }
     old_code_ptr[1] = s->code_ptr - old_code_ptr;
+    tci_out_fuse(s, old_code_ptr);
 }
 
 static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
@@ -582,7 +659,7 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
         tcg_out_ri(s, const_args[0], args[0]);
         break;
     case INDEX_op_jmp:
-        TODO();
+        tcg_out_ri(s, const_args[0], args[0]);
         break;
     case INDEX_op_setcond_i32:
         tcg_out_r(s, args[0]);
@@ -828,6 +905,7 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
         tcg_abort();
     }
     old_code_ptr[1] = s->code_ptr - old_code_ptr;
+    tci_out_fuse(s, old_code_ptr);
 }
 
 static void tcg_out_st(TCGContext *s, TCGType type, TCGReg arg, TCGReg arg1,
@@ -851,6 +929,7 @@ static void tcg_out_st(TCGContext *s, TCGType type, TCGReg arg, TCGReg arg1,
 #endif
     }
     old_code_ptr[1] = s->code_ptr - old_code_ptr;
+    tci_out_fuse(s, old_code_ptr);
 }
 
 /* Test if a constant matches the constraint. */
@@ -878,6 +957,7 @@ static void tcg_target_init(TCGContext *s)
 
     /* The current code uses uint8_t for tcg operations. */
     assert(ARRAY_SIZE(tcg_op_defs) <= UINT8_MAX);
+    assert(TCI_NB_OPS <= UINT8_MAX);
 
     /* Registers available for 32 bit operations. */
     tcg_regset_set32(tcg_target_available_regs[TCG_TYPE_I32], 0,
@@ -103,6 +103,30 @@
 /* Offset to user memory in user mode. */
 #define TCG_TARGET_HAS_GUEST_BASE
 
+/* Dispatch the interpreted code with computed gotos (threaded code).
+   Build with --extra-cflags=-DTCI_SWITCH_DISPATCH to get the plain
+   switch loop, e.g. for speed comparisons. */
+#if defined(__GNUC__) && !defined(TCI_SWITCH_DISPATCH)
+#define TCI_THREADED
+#endif
+
+/* Superinstructions for frequent pairs of operations, threaded code only.
+   The backend replaces the opcode of the first operation of a pair,
+   all other bytes are unchanged, so the second operation can still be
+   the target of a branch. */
+#define INDEX_op_tci_ld_add_i32         (NB_OPS + 0)
+#define INDEX_op_tci_st_st_i32          (NB_OPS + 1)
+#define INDEX_op_tci_setcond_brcond_i32 (NB_OPS + 2)
+#if TCG_TARGET_REG_BITS == 64
+#define INDEX_op_tci_ld_add_i64         (NB_OPS + 3)
+#define INDEX_op_tci_ld_ld_i64          (NB_OPS + 4)
+#define INDEX_op_tci_st_st_i64          (NB_OPS + 5)
+#define INDEX_op_tci_setcond_brcond_i64 (NB_OPS + 6)
+#define TCI_NB_OPS                      (NB_OPS + 7)
+#else
+#define TCI_NB_OPS                      (NB_OPS + 3)
+#endif
+
 /* Number of registers available.
    For 32 bit hosts, we need more than 8 registers (call arguments). */
 /* #define TCG_TARGET_NB_REGS 8 */
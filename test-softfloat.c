@@ -0,0 +1,271 @@
+/*
+ * softfloat host FPU fast path check and benchmark
+ *
+ * Runs float32 and float64 add, sub, mul, div and sqrt over a mix of
+ * random and corner case operands, once with the host FPU fast path
+ * enabled and once with the pure softfloat code, and checks that the
+ * results and exception flags are bit for bit identical.  Then times
+ * both paths.  Built per target (the NaN conventions are target specific)
+ * with "make test-softfloat" in a target directory.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "softfloat.h"
+
+#define NB_OPERANDS 4096
+#define NB_BENCH_LOOPS 2000
+
+enum {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_SQRT,
+    NB_OPS
+};
+
+static const char * const op_names[NB_OPS] = {
+    "add", "sub", "mul", "div", "sqrt"
+};
+
+static uint32_t f32_ops[NB_OPERANDS];
+static uint64_t f64_ops[NB_OPERANDS];
+
+static uint64_t rand_state = 0x123456789abcdefULL;
+
+static uint64_t rand64(void)
+{
+    /* xorshift, so that the operands are the same on every host */
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+static const uint32_t f32_special[] = {
+    0x00000000, 0x80000000, 0x00000001, 0x807fffff, 0x00800000, 0x00800001,
+    0x7f7fffff, 0xff7fffff, 0x7f800000, 0xff800000, 0x7fc00000, 0x7f800001,
+    0x3f800000, 0xbf800000, 0x3f800001, 0x34000000, 0x1f800000, 0x5f800000,
+};
+
+static const uint64_t f64_special[] = {
+    0x0000000000000000ULL, 0x8000000000000000ULL, 0x0000000000000001ULL,
+    0x800fffffffffffffULL, 0x0010000000000000ULL, 0x0010000000000001ULL,
+    0x7fefffffffffffffULL, 0xffefffffffffffffULL, 0x7ff0000000000000ULL,
+    0xfff0000000000000ULL, 0x7ff8000000000000ULL, 0x7ff0000000000001ULL,
+    0x3ff0000000000000ULL, 0xbff0000000000000ULL, 0x3ff0000000000001ULL,
+    0x3cb0000000000000ULL, 0x1ff0000000000000ULL, 0x5ff0000000000000ULL,
+};
+
+static void init_operands(void)
+{
+    int i, nb32, nb64;
+    uint64_t r;
+
+    nb32 = sizeof(f32_special) / sizeof(f32_special[0]);
+    nb64 = sizeof(f64_special) / sizeof(f64_special[0]);
+    for (i = 0; i < NB_OPERANDS; i++) {
+        r = rand64();
+        switch (r & 7) {
+        case 0:
+            /* corner cases */
+            f32_ops[i] = f32_special[(r >> 8) % nb32];
+            f64_ops[i] = f64_special[(r >> 8) % nb64];
+            break;
+        case 1:
+            /* anything, including denormals and NaNs */
+            f32_ops[i] = r >> 32;
+            f64_ops[i] = rand64();
+            break;
+        default:
+            /* numbers of moderate magnitude, the common case */
+            f32_ops[i] = (r >> 32 & 0x807fffff) | (((r >> 3) % 64 + 95) << 23);
+            f64_ops[i] = (rand64() & 0x800fffffffffffffULL) |
+                ((uint64_t)((r >> 3) % 512 + 767) << 52);
+            break;
+        }
+    }
+}
+
+static float32 do_f32(int op, float32 a, float32 b, float_status *s)
+{
+    switch (op) {
+    case OP_ADD:
+        return float32_add(a, b, s);
+    case OP_SUB:
+        return float32_sub(a, b, s);
+    case OP_MUL:
+        return float32_mul(a, b, s);
+    case OP_DIV:
+        return float32_div(a, b, s);
+    default:
+        return float32_sqrt(a, s);
+    }
+}
+
+static float64 do_f64(int op, float64 a, float64 b, float_status *s)
+{
+    switch (op) {
+    case OP_ADD:
+        return float64_add(a, b, s);
+    case OP_SUB:
+        return float64_sub(a, b, s);
+    case OP_MUL:
+        return float64_mul(a, b, s);
+    case OP_DIV:
+        return float64_div(a, b, s);
+    default:
+        return float64_sqrt(a, s);
+    }
+}
+
+static void init_status(float_status *s, int rounding_mode, int flags)
+{
+    memset(s, 0, sizeof(*s));
+    set_float_rounding_mode(rounding_mode, s);
+    set_float_exception_flags(flags, s);
+}
+
+/* Returns the number of mismatches. */
+static int check(int rounding_mode, int flags)
+{
+    float_status hs, ss;
+    uint32_t h32, s32;
+    uint64_t h64, s64;
+    int op, i, errors = 0;
+
+    for (op = 0; op < NB_OPS; op++) {
+        for (i = 0; i < NB_OPERANDS; i++) {
+            uint32_t a32 = f32_ops[i], b32 = f32_ops[(i * 7 + 1) % NB_OPERANDS];
+            uint64_t a64 = f64_ops[i], b64 = f64_ops[(i * 7 + 1) % NB_OPERANDS];
+
+            init_status(&hs, rounding_mode, flags);
+            init_status(&ss, rounding_mode, flags);
+            float_use_host_fpu = 1;
+            h32 = float32_val(do_f32(op, make_float32(a32),
+                                     make_float32(b32), &hs));
+            float_use_host_fpu = 0;
+            s32 = float32_val(do_f32(op, make_float32(a32),
+                                     make_float32(b32), &ss));
+            if (h32 != s32 || get_float_exception_flags(&hs) !=
+                get_float_exception_flags(&ss)) {
+                if (errors++ < 10) {
+                    printf("float32_%s(%08x, %08x): %08x/%02x != %08x/%02x\n",
+                           op_names[op], a32, b32,
+                           h32, get_float_exception_flags(&hs),
+                           s32, get_float_exception_flags(&ss));
+                }
+            }
+
+            init_status(&hs, rounding_mode, flags);
+            init_status(&ss, rounding_mode, flags);
+            float_use_host_fpu = 1;
+            h64 = float64_val(do_f64(op, make_float64(a64),
+                                     make_float64(b64), &hs));
+            float_use_host_fpu = 0;
+            s64 = float64_val(do_f64(op, make_float64(a64),
+                                     make_float64(b64), &ss));
+            if (h64 != s64 || get_float_exception_flags(&hs) !=
+                get_float_exception_flags(&ss)) {
+                if (errors++ < 10) {
+                    printf("float64_%s(%016llx, %016llx): "
+                           "%016llx/%02x != %016llx/%02x\n",
+                           op_names[op], (unsigned long long)a64,
+                           (unsigned long long)b64,
+                           (unsigned long long)h64,
+                           get_float_exception_flags(&hs),
+                           (unsigned long long)s64,
+                           get_float_exception_flags(&ss));
+                }
+            }
+        }
+    }
+    float_use_host_fpu = 1;
+    return errors;
+}
+
+static int64_t get_clock(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void bench(void)
+{
+    float_status s;
+    int op, i, j, host;
+    int64_t ti[2];
+    uint64_t sum = 0;
+
+    init_status(&s, float_round_nearest_even, float_flag_inexact);
+    for (op = 0; op < NB_OPS; op++) {
+        for (host = 0; host < 2; host++) {
+            float_use_host_fpu = host;
+            ti[host] = get_clock();
+            for (j = 0; j < NB_BENCH_LOOPS; j++) {
+                for (i = 0; i < NB_OPERANDS - 1; i++) {
+                    sum += float32_val(do_f32(op, make_float32(f32_ops[i]),
+                                              make_float32(f32_ops[i + 1]),
+                                              &s));
+                }
+            }
+            ti[host] = get_clock() - ti[host];
+        }
+        printf("float32_%-5s soft %6.2f ns  host %6.2f ns\n", op_names[op],
+               ti[0] * 1000.0 / NB_BENCH_LOOPS / (NB_OPERANDS - 1),
+               ti[1] * 1000.0 / NB_BENCH_LOOPS / (NB_OPERANDS - 1));
+    }
+    for (op = 0; op < NB_OPS; op++) {
+        for (host = 0; host < 2; host++) {
+            float_use_host_fpu = host;
+            ti[host] = get_clock();
+            for (j = 0; j < NB_BENCH_LOOPS; j++) {
+                for (i = 0; i < NB_OPERANDS - 1; i++) {
+                    sum += float64_val(do_f64(op, make_float64(f64_ops[i]),
+                                              make_float64(f64_ops[i + 1]),
+                                              &s));
+                }
+            }
+            ti[host] = get_clock() - ti[host];
+        }
+        printf("float64_%-5s soft %6.2f ns  host %6.2f ns\n", op_names[op],
+               ti[0] * 1000.0 / NB_BENCH_LOOPS / (NB_OPERANDS - 1),
+               ti[1] * 1000.0 / NB_BENCH_LOOPS / (NB_OPERANDS - 1));
+    }
+    float_use_host_fpu = 1;
+    /* keep the results live */
+    if (sum == 1) {
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const int modes[] = {
+        float_round_nearest_even, float_round_down,
+        float_round_up, float_round_to_zero
+    };
+    int i, errors = 0;
+
+    init_operands();
+    for (i = 0; i < 4; i++) {
+        errors += check(modes[i], 0);
+        errors += check(modes[i], float_flag_inexact);
+        errors += check(modes[i], float_flag_inexact | float_flag_invalid);
+    }
+    printf("%d mismatches\n", errors);
+    if (errors) {
+        return 1;
+    }
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        bench();
+    }
+    return 0;
+}
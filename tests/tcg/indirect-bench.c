@@ -0,0 +1,143 @@
+/*
+ * Indirect branch benchmark
+ *
+ * Exercises the kinds of control flow that end a translated block with a
+ * computed target: switch based bytecode dispatch, calls through function
+ * pointers and deep call/return chains.  Each kernel prints its run time
+ * together with a checksum, so that the output of a native run and of an
+ * emulated run can be compared both for speed and for correctness.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define LOOPS 200000
+
+static int64_t get_clock(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* a tiny stack machine; the dispatch switch compiles to a jump table */
+enum {
+    OP_PUSH, OP_ADD, OP_SUB, OP_XOR, OP_SHL, OP_DUP, OP_OVER, OP_SWAP,
+    OP_DROP, OP_JNZ, OP_HALT,
+};
+
+/* acc = seed; for (n = 16; n != 0; n--) acc = ((acc << 5) ^ 7) + n; */
+static const uint8_t program[] = {
+    OP_PUSH, 16,
+    OP_SWAP, OP_PUSH, 5, OP_SHL, OP_PUSH, 7, OP_XOR, OP_OVER, OP_ADD,
+    OP_SWAP, OP_PUSH, 1, OP_SUB, OP_DUP, OP_JNZ, 2,
+    OP_DROP, OP_HALT,
+};
+
+static uint32_t interp(const uint8_t *code, uint32_t seed)
+{
+    uint32_t stack[16], a, b;
+    int sp = 0, pc = 0;
+
+    stack[sp++] = seed;
+    for (;;) {
+        switch (code[pc++]) {
+        case OP_PUSH:
+            stack[sp++] = code[pc++];
+            break;
+        case OP_ADD:
+            b = stack[--sp]; a = stack[--sp];
+            stack[sp++] = a + b;
+            break;
+        case OP_SUB:
+            b = stack[--sp]; a = stack[--sp];
+            stack[sp++] = a - b;
+            break;
+        case OP_XOR:
+            b = stack[--sp]; a = stack[--sp];
+            stack[sp++] = a ^ b;
+            break;
+        case OP_SHL:
+            b = stack[--sp]; a = stack[--sp];
+            stack[sp++] = a << (b & 31);
+            break;
+        case OP_DUP:
+            a = stack[sp - 1];
+            stack[sp++] = a;
+            break;
+        case OP_OVER:
+            a = stack[sp - 2];
+            stack[sp++] = a;
+            break;
+        case OP_SWAP:
+            a = stack[sp - 1];
+            stack[sp - 1] = stack[sp - 2];
+            stack[sp - 2] = a;
+            break;
+        case OP_DROP:
+            sp--;
+            break;
+        case OP_JNZ:
+            a = stack[--sp];
+            if (a) {
+                pc = code[pc];
+            } else {
+                pc++;
+            }
+            break;
+        case OP_HALT:
+        default:
+            return stack[sp - 1];
+        }
+    }
+}
+
+typedef uint32_t (*op_fn)(uint32_t, uint32_t);
+
+static uint32_t fn_add(uint32_t a, uint32_t b) { return a + b; }
+static uint32_t fn_xor(uint32_t a, uint32_t b) { return a ^ b; }
+static uint32_t fn_rol(uint32_t a, uint32_t b) { return (a << 5) | (a >> 27); }
+static uint32_t fn_mul(uint32_t a, uint32_t b) { return a * (b | 1); }
+
+/* volatile so that the calls cannot be devirtualized */
+static op_fn volatile fn_table[4] = { fn_add, fn_xor, fn_rol, fn_mul };
+
+static uint32_t fib(uint32_t n)
+{
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+static void report(const char *name, int64_t ti, uint32_t sum)
+{
+    printf("%-10s %8.3f s  checksum=%08x\n", name, ti / 1000000.0, sum);
+}
+
+int main(int argc, char **argv)
+{
+    int64_t ti;
+    uint32_t sum;
+    int i;
+
+    ti = get_clock();
+    sum = 0;
+    for (i = 0; i < LOOPS; i++) {
+        sum += interp(program, i);
+    }
+    report("interp", get_clock() - ti, sum);
+
+    ti = get_clock();
+    sum = 1;
+    for (i = 0; i < LOOPS * 50; i++) {
+        sum = fn_table[(sum ^ i) & 3](sum, i);
+    }
+    report("fnptr", get_clock() - ti, sum);
+
+    ti = get_clock();
+    sum = 0;
+    for (i = 0; i < 20; i++) {
+        sum += fib(24 + (i & 1));
+    }
+    report("recursion", get_clock() - ti, sum);
+    return 0;
+}
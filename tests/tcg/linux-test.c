@@ -38,6 +38,9 @@
 #include <dirent.h>
 #include <setjmp.h>
 #include <sys/shm.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
 
 #define TESTPATH "/tmp/linux-test.tmp"
 #define TESTPORT 7654
@@ -389,6 +392,95 @@ void test_pipe(void)
     chk_error(close(fds[1]));
 }
 
+void test_epoll(void)
+{
+    struct epoll_event ev, evs[4];
+    int epfd, fds[2], ret;
+    uint8_t ch = 'a';
+
+    chk_error(pipe(fds));
+    epfd = chk_error(epoll_create(4));
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0x123456789abcdef0ULL;
+    chk_error(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev));
+    ret = chk_error(epoll_wait(epfd, evs, 4, 0));
+    if (ret != 0)
+        error("epoll_wait");
+    chk_error(write(fds[1], &ch, 1));
+    ret = chk_error(epoll_wait(epfd, evs, 4, 1000));
+    if (ret != 1 || evs[0].events != EPOLLIN ||
+        evs[0].data.u64 != 0x123456789abcdef0ULL)
+        error("epoll_wait");
+    chk_error(close(epfd));
+    chk_error(close(fds[0]));
+    chk_error(close(fds[1]));
+}
+
+#define AIO_NR 8
+#define AIO_BLOCK 512
+
+void test_aio(void)
+{
+    aio_context_t ctx = 0;
+    struct iocb cbs[AIO_NR], *cbp[AIO_NR];
+    struct io_event evs[AIO_NR];
+    uint8_t buf[AIO_NR][AIO_BLOCK];
+    int fd, i, n, ret;
+
+    if (syscall(__NR_io_setup, AIO_NR, &ctx) < 0) {
+        /* not available for this guest/host combination */
+        if (errno == ENOSYS)
+            return;
+        error("io_setup");
+    }
+    fd = chk_error(open(TESTPATH, O_RDWR | O_CREAT | O_TRUNC, 0644));
+    for (i = 0; i < AIO_NR; i++) {
+        memset(buf[i], i + 1, AIO_BLOCK);
+        memset(&cbs[i], 0, sizeof(cbs[i]));
+        cbs[i].aio_fildes = fd;
+        cbs[i].aio_lio_opcode = IOCB_CMD_PWRITE;
+        cbs[i].aio_buf = (uintptr_t)buf[i];
+        cbs[i].aio_nbytes = AIO_BLOCK;
+        cbs[i].aio_offset = i * AIO_BLOCK;
+        cbs[i].aio_data = i;
+        cbp[i] = &cbs[i];
+    }
+    ret = chk_error(syscall(__NR_io_submit, ctx, AIO_NR, cbp));
+    if (ret != AIO_NR)
+        error("io_submit");
+    for (n = 0; n < AIO_NR; n += ret) {
+        ret = chk_error(syscall(__NR_io_getevents, ctx, 1, AIO_NR - n,
+                                evs, NULL));
+        for (i = 0; i < ret; i++) {
+            if (evs[i].res != AIO_BLOCK ||
+                evs[i].obj != (uintptr_t)&cbs[evs[i].data])
+                error("io_getevents");
+        }
+    }
+
+    /* read back in reverse order */
+    memset(buf, 0, sizeof(buf));
+    for (i = 0; i < AIO_NR; i++) {
+        cbs[i].aio_lio_opcode = IOCB_CMD_PREAD;
+        cbs[i].aio_offset = (AIO_NR - 1 - i) * AIO_BLOCK;
+    }
+    ret = chk_error(syscall(__NR_io_submit, ctx, AIO_NR, cbp));
+    if (ret != AIO_NR)
+        error("io_submit");
+    for (n = 0; n < AIO_NR; n += ret) {
+        ret = chk_error(syscall(__NR_io_getevents, ctx, 1, AIO_NR - n,
+                                evs, NULL));
+    }
+    for (i = 0; i < AIO_NR; i++) {
+        if (buf[i][0] != AIO_NR - i || buf[i][AIO_BLOCK - 1] != AIO_NR - i)
+            error("aio read");
+    }
+    chk_error(syscall(__NR_io_destroy, ctx));
+    chk_error(close(fd));
+    chk_error(unlink(TESTPATH));
+}
+
 int thread1_res;
 int thread2_res;
 
@@ -530,6 +622,8 @@ int main(int argc, char **argv)
     test_fork();
     test_time();
     test_socket();
+    test_epoll();
+    test_aio();
     //    test_clone();
     test_signal();
     test_shm();
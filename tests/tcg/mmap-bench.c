@@ -0,0 +1,83 @@
+/*
+ * mmap/munmap scaling benchmark
+ *
+ * N threads each map a small anonymous region, touch every page of it
+ * and unmap it again in a loop, like a multithreaded allocator does.
+ * The run is repeated for 1, 2, 4, ... up to the given number of
+ * threads so that the scaling of the emulated address space
+ * management can be compared with a native run.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define LOOPS 20000
+#define MAP_PAGES 16
+
+static long page_size;
+
+static int64_t get_clock(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void *churn(void *arg)
+{
+    size_t len = MAP_PAGES * page_size;
+    unsigned long sum = 0;
+    char *p;
+    int i, j;
+
+    for (i = 0; i < LOOPS; i++) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        for (j = 0; j < MAP_PAGES; j++) {
+            p[j * page_size] = j;
+            sum += p[j * page_size];
+        }
+        if (munmap(p, len) != 0) {
+            perror("munmap");
+            exit(1);
+        }
+    }
+    return (void *)sum;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t tid[64];
+    int max_threads, n, i;
+    int64_t ti;
+    double secs;
+
+    max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    if (max_threads < 1 || max_threads > 64) {
+        fprintf(stderr, "usage: %s [threads (1-64)]\n", argv[0]);
+        return 1;
+    }
+    page_size = sysconf(_SC_PAGESIZE);
+
+    for (n = 1; n <= max_threads; n *= 2) {
+        ti = get_clock();
+        for (i = 0; i < n; i++) {
+            pthread_create(&tid[i], NULL, churn, NULL);
+        }
+        for (i = 0; i < n; i++) {
+            pthread_join(tid[i], NULL);
+        }
+        secs = (get_clock() - ti) / 1000000.0;
+        printf("threads=%-2d %8.3f s %10.0f mmap+munmap/s\n",
+               n, secs, n * LOOPS / secs);
+    }
+    return 0;
+}
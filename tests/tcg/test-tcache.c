@@ -0,0 +1,31 @@
+/*
+ * Persistent translation cache test
+ *
+ * The program is built twice with a different TCACHE_STEP, which only
+ * changes an immediate operand in the loop below.  A run of the second
+ * binary with the cache written by the first one must not execute the
+ * stale translation of that loop.
+ */
+#include <stdio.h>
+
+#ifndef TCACHE_STEP
+#define TCACHE_STEP 3
+#endif
+
+static unsigned int __attribute__((noinline)) work(unsigned int n)
+{
+    unsigned int i, x = 1;
+
+    for (i = 0; i < n; i++) {
+        x = x * 31 + (i ^ TCACHE_STEP);
+    }
+    return x;
+}
+
+int main(void)
+{
+    volatile unsigned int n = 1000000;
+
+    printf("%08x\n", work(n));
+    return 0;
+}
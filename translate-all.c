@@ -39,6 +39,179 @@ TCGArg gen_opparam_buf[OPPARAM_BUF_SIZE];
 target_ulong gen_opc_pc[OPC_BUF_SIZE];
 uint16_t gen_opc_icount[OPC_BUF_SIZE];
 uint8_t gen_opc_instr_start[OPC_BUF_SIZE];
+uint16_t gen_opc_host_end[OPC_BUF_SIZE];
+
+/* PC mapping tables.
+
+   cpu_gen_code() writes a table after the host code of each TB so that
+   cpu_restore_state() does not have to translate the TB again.  It starts
+   with the number of guest instructions, followed by one entry per
+   instruction: the end of its host code, its PC, the instruction count
+   and the TARGET_INSN_EXTRA_WORDS words of target state, each as the
+   LEB128 encoded difference to the previous entry (signed, except for the
+   host offset).  The first entry is relative to host offset 0, tb->pc
+   and zeros. */
+
+#define PC_MAP_WORDS (2 + TARGET_INSN_EXTRA_WORDS)
+
+static uint8_t *encode_uleb128(uint8_t *p, uint32_t val)
+{
+    while (val >= 0x80) {
+        *p++ = val | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+    return p;
+}
+
+static uint8_t *encode_sleb128(uint8_t *p, int64_t val)
+{
+    while (val < -0x40 || val >= 0x40) {
+        *p++ = val | 0x80;
+        val >>= 7;
+    }
+    *p++ = val & 0x7f;
+    return p;
+}
+
+static const uint8_t *decode_uleb128(const uint8_t *p, uint32_t *val)
+{
+    uint32_t v = 0;
+    int shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = *p++;
+        v |= (uint32_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    *val = v;
+    return p;
+}
+
+static const uint8_t *decode_sleb128(const uint8_t *p, int64_t *val)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = *p++;
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    if (shift < 64 && (byte & 0x40)) {
+        v |= -(uint64_t)1 << shift;
+    }
+    *val = v;
+    return p;
+}
+
+/* Get the state of the guest instruction starting at op index 'j'. */
+static void pc_map_get(target_ulong *words, int j)
+{
+    words[0] = gen_opc_pc[j];
+    words[1] = gen_opc_icount[j];
+#if TARGET_INSN_EXTRA_WORDS > 0
+    save_opc_extra(words + 2, j);
+#endif
+}
+
+/* Write the PC mapping table of the 'nb_ops' ops just translated to 'p'.
+   Return its size. */
+static int encode_pc_map(TranslationBlock *tb, uint8_t *p, int nb_ops,
+                         int code_size)
+{
+    uint8_t *start = p;
+    target_ulong prev[PC_MAP_WORDS], cur[PC_MAP_WORDS];
+    uint32_t prev_end, end;
+    int i, j, next, nb_insns;
+
+    nb_insns = 0;
+    for (j = 0; j < nb_ops; j++) {
+        nb_insns += gen_opc_instr_start[j];
+    }
+    p = encode_uleb128(p, nb_insns);
+
+    memset(prev, 0, sizeof(prev));
+    prev[0] = tb->pc;
+    prev_end = 0;
+    for (j = 0; j < nb_ops && !gen_opc_instr_start[j]; j++) {
+        continue;
+    }
+    while (j < nb_ops) {
+        for (next = j + 1; next < nb_ops && !gen_opc_instr_start[next];
+             next++) {
+            continue;
+        }
+        end = next < nb_ops ? gen_opc_host_end[next - 1] : code_size;
+        pc_map_get(cur, j);
+        p = encode_uleb128(p, end - prev_end);
+        for (i = 0; i < PC_MAP_WORDS; i++) {
+            p = encode_sleb128(p, (target_long)(cur[i] - prev[i]));
+            prev[i] = cur[i];
+        }
+        prev_end = end;
+        j = next;
+    }
+    return p - start;
+}
+
+/* Find the guest instruction whose host code contains 'offset' and store
+   its state at index 0 of the gen_opc_* arrays.  Return 0 on success. */
+static int decode_pc_map(TranslationBlock *tb, uint32_t offset)
+{
+    const uint8_t *p = tb->tc_ptr + tb->pc_map_offset;
+    target_ulong words[PC_MAP_WORDS];
+    uint32_t nb_insns, delta, end;
+    int64_t val;
+    int i, k;
+
+    memset(words, 0, sizeof(words));
+    words[0] = tb->pc;
+    end = 0;
+    p = decode_uleb128(p, &nb_insns);
+    for (k = 0; k < nb_insns; k++) {
+        p = decode_uleb128(p, &delta);
+        end += delta;
+        for (i = 0; i < PC_MAP_WORDS; i++) {
+            p = decode_sleb128(p, &val);
+            words[i] += val;
+        }
+        if (offset < end) {
+            gen_opc_pc[0] = words[0];
+            gen_opc_icount[0] = words[1];
+            gen_opc_instr_start[0] = 1;
+#if TARGET_INSN_EXTRA_WORDS > 0
+            load_opc_extra(words + 2, 0);
+#endif
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Return the size of the PC mapping table of 'tb' in bytes. */
+int tb_pc_map_size(TranslationBlock *tb)
+{
+    const uint8_t *start, *p;
+    uint32_t nb_insns, delta;
+    int64_t val;
+    int i, k;
+
+    if (!tb->pc_map_offset) {
+        return 0;
+    }
+    start = p = tb->tc_ptr + tb->pc_map_offset;
+    p = decode_uleb128(p, &nb_insns);
+    for (k = 0; k < nb_insns; k++) {
+        p = decode_uleb128(p, &delta);
+        for (i = 0; i < PC_MAP_WORDS; i++) {
+            p = decode_sleb128(p, &val);
+        }
+    }
+    return p - start;
+}
 
 void cpu_gen_init(void)
 {
@@ -49,13 +222,13 @@ void cpu_gen_init(void)
    the virtual CPU can trigger an exception.
 
    '*gen_code_size_ptr' contains the size of the generated code (host
-   code).
+   code and PC mapping table).
 */
 int cpu_gen_code(CPUState *env, TranslationBlock *tb, int *gen_code_size_ptr)
 {
     TCGContext *s = &tcg_ctx;
     uint8_t *gen_code_buf;
-    int gen_code_size;
+    int gen_code_size, nb_ops;
 #ifdef CONFIG_PROFILER
     int64_t ti;
 #endif
@@ -67,7 +240,9 @@ int cpu_gen_code(CPUState *env, TranslationBlock *tb, int *gen_code_size_ptr)
 #endif
     tcg_func_start(s);
 
-    gen_intermediate_code(env, tb);
+    /* record the state of each guest instruction for the PC mapping table */
+    gen_intermediate_code_pc(env, tb);
+    nb_ops = gen_opc_ptr - gen_opc_buf;
 
     /* generate machine code */
     gen_code_buf = tb->tc_ptr;
@@ -81,6 +256,8 @@ int cpu_gen_code(CPUState *env, TranslationBlock *tb, int *gen_code_size_ptr)
     s->tb_jmp_offset = NULL;
     s->tb_next = tb->tb_next;
 #endif
+    /* when the JIT profiler picks the hot TBs, only optimize those */
+    s->skip_optimize = tb_profile_hot_samples && !(tb->cflags & CF_HOT);
 
 #ifdef CONFIG_PROFILER
     s->tb_count++;
@@ -88,7 +265,6 @@ int cpu_gen_code(CPUState *env, TranslationBlock *tb, int *gen_code_size_ptr)
     s->code_time -= profile_getclock();
 #endif
     gen_code_size = tcg_gen_code(s, gen_code_buf);
-    *gen_code_size_ptr = gen_code_size;
 #ifdef CONFIG_PROFILER
     s->code_time += profile_getclock();
     s->code_in_len += tb->size;
@@ -97,12 +273,22 @@ int cpu_gen_code(CPUState *env, TranslationBlock *tb, int *gen_code_size_ptr)
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_OUT_ASM)) {
-        qemu_log("OUT: [size=%d]\n", *gen_code_size_ptr);
-        log_disas(tb->tc_ptr, *gen_code_size_ptr);
+        qemu_log("OUT: [size=%d]\n", gen_code_size);
+        log_disas(tb->tc_ptr, gen_code_size);
         qemu_log("\n");
         qemu_log_flush();
     }
 #endif
+
+    /* the table offset has to fit in 16 bits like tb_next_offset */
+    if (gen_code_size < 0xffff) {
+        tb->pc_map_offset = gen_code_size;
+        gen_code_size += encode_pc_map(tb, gen_code_buf + gen_code_size,
+                                       nb_ops, gen_code_size);
+    } else {
+        tb->pc_map_offset = 0;
+    }
+    *gen_code_size_ptr = gen_code_size;
     return 0;
 }
 
@@ -121,9 +307,37 @@ int cpu_restore_state(TranslationBlock *tb,
 #ifdef CONFIG_PROFILER
     ti = profile_getclock();
 #endif
-    tcg_func_start(s);
+    tc_ptr = (unsigned long)tb->tc_ptr;
+    if (searched_pc < tc_ptr)
+        return -1;
 
-    gen_intermediate_code_pc(env, tb);
+    if (tb->pc_map_offset) {
+        if (decode_pc_map(tb, searched_pc - tc_ptr) < 0)
+            return -1;
+        j = 0;
+    } else {
+        /* no table: translate the TB again */
+        tcg_func_start(s);
+
+        gen_intermediate_code_pc(env, tb);
+
+        s->tb_next_offset = tb->tb_next_offset;
+#ifdef USE_DIRECT_JUMP
+        s->tb_jmp_offset = tb->tb_jmp_offset;
+        s->tb_next = NULL;
+#else
+        s->tb_jmp_offset = NULL;
+        s->tb_next = tb->tb_next;
+#endif
+        s->skip_optimize = tb_profile_hot_samples && !(tb->cflags & CF_HOT);
+        /* find opc index corresponding to search_pc */
+        j = tcg_gen_code_search_pc(s, (uint8_t *)tc_ptr, searched_pc - tc_ptr);
+        if (j < 0)
+            return -1;
+        /* now find start of instruction before */
+        while (gen_opc_instr_start[j] == 0)
+            j--;
+    }
 
     if (use_icount) {
         /* Reset the cycle counter to the start of the block.  */
@@ -131,26 +345,6 @@ int cpu_restore_state(TranslationBlock *tb,
         /* Clear the IO flag.  */
         env->can_do_io = 0;
     }
-
-    /* find opc index corresponding to search_pc */
-    tc_ptr = (unsigned long)tb->tc_ptr;
-    if (searched_pc < tc_ptr)
-        return -1;
-
-    s->tb_next_offset = tb->tb_next_offset;
-#ifdef USE_DIRECT_JUMP
-    s->tb_jmp_offset = tb->tb_jmp_offset;
-    s->tb_next = NULL;
-#else
-    s->tb_jmp_offset = NULL;
-    s->tb_next = tb->tb_next;
-#endif
-    j = tcg_gen_code_search_pc(s, (uint8_t *)tc_ptr, searched_pc - tc_ptr);
-    if (j < 0)
-        return -1;
-    /* now find start of instruction before */
-    while (gen_opc_instr_start[j] == 0)
-        j--;
     env->icount_decr.u16.low -= gen_opc_icount[j];
 
     restore_state_to_opc(env, tb, j);
@@ -3024,6 +3024,23 @@ int main(int argc, char **argv, char **envp)
                     tcg_tb_size = 0;
                 }
                 break;
+            case QEMU_OPTION_tb_jmp_cache_bits:
+                if (tb_jmp_cache_set_bits(strtoul(optarg, NULL, 0)) < 0) {
+                    fprintf(stderr, "qemu: invalid jump cache size: %s\n",
+                            optarg);
+                    exit(1);
+                }
+                break;
+            case QEMU_OPTION_perfmap:
+                tb_perf_map_enable();
+                break;
+            case QEMU_OPTION_jit_profile:
+                if (tb_profile_configure(optarg) < 0) {
+                    fprintf(stderr, "qemu: invalid -jit-profile options: %s\n",
+                            optarg);
+                    exit(1);
+                }
+                break;
             case QEMU_OPTION_icount:
                 icount_option = optarg;
                 break;
@@ -3526,6 +3543,7 @@ int main(int argc, char **argv, char **envp)
     }
 
     os_setup_post();
+    tb_profile_start();
 
     resume_all_vcpus();
     main_loop();